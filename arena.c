@@ -0,0 +1,88 @@
+// Bump-pointer memory arenas
+//
+// The compiler builds lots of small objects (AST nodes,
+// symbols, instructions) which all die at the same time,
+// either at the end of a function or at the end of a file.
+// Rather than malloc() and never free() each one, we hand
+// them out of an arena and reset the arena when they die.
+// A reset keeps the arena's blocks for reuse, so after the
+// first few functions we stop calling malloc() at all.
+
+#include "data.h"
+#include "misc.h"
+#include "arena.h"
+
+// Default size of a block in bytes
+#define ARENABLOCK 65536
+
+struct arena *newarena(void) {
+  struct arena *a = (struct arena *) malloc(sizeof(struct arena));
+
+  if (a == NULL)
+    fatal("Unable to malloc an arena in newarena");
+
+  a->first = a->cur = NULL;
+  a->inuse = a->peak = 0;
+  return a;
+}
+
+static struct arenablock *newblock(int size) {
+  struct arenablock *b = (struct arenablock *) malloc(sizeof(struct arenablock));
+
+  if (b == NULL)
+    fatal("Unable to malloc an arena block in newblock");
+  b->mem = (char *) malloc(size);
+  if (b->mem == NULL)
+    fatal("Unable to malloc an arena block in newblock");
+
+  b->size = size;
+  b->used = 0;
+  b->next = NULL;
+  return b;
+}
+
+void *arenaalloc(struct arena *a, int size) {
+  struct arenablock *b;
+  char *p;
+
+  // Keep everything 8-byte aligned
+  size = (size + 7) & ~7;
+
+  // Move along to the first block with enough room,
+  // adding a new block on the end if we run out
+  if (a->cur == NULL) {
+    if (a->first == NULL)
+      a->first = newblock(size > ARENABLOCK ? size : ARENABLOCK);
+    a->cur = a->first;
+  }
+  while (a->cur->used + size > a->cur->size) {
+    if (a->cur->next == NULL)
+      a->cur->next = newblock(size > ARENABLOCK ? size : ARENABLOCK);
+    a->cur = a->cur->next;
+  }
+
+  b = a->cur;
+  p = b->mem + b->used;
+  b->used = b->used + size;
+  a->inuse = a->inuse + size;
+  if (a->inuse > a->peak)
+    a->peak = a->inuse;
+
+  return memset(p, 0, size);
+}
+
+char *arenastrdup(struct arena *a, char *s) {
+  char *p = (char *) arenaalloc(a, (int) strlen(s) + 1);
+
+  strcpy(p, s);
+  return p;
+}
+
+void arenareset(struct arena *a) {
+  struct arenablock *b;
+
+  for (b = a->first; b != NULL; b = b->next)
+    b->used = 0;
+  a->cur = a->first;
+  a->inuse = 0;
+}
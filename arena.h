@@ -0,0 +1,8 @@
+// Create a new, empty arena
+struct arena *newarena(void);
+// Return size bytes of zeroed memory from the arena
+void *arenaalloc(struct arena *a, int size);
+// Copy a string into the arena
+char *arenastrdup(struct arena *a, char *s);
+// Release everything in the arena for reuse
+void arenareset(struct arena *a);
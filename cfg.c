@@ -0,0 +1,306 @@
+// Basic blocks, control flow graph and liveness
+//
+// A function's instruction list is cut into basic blocks: a
+// block starts at a label or just after a jump, and ends at a
+// jump or just before a label. Each block is linked to the
+// blocks which control can pass to next, and from these we
+// work out which registers, physical and virtual, hold a value
+// that may still be needed on the way into and out of each
+// block. The register allocator uses this to keep a value in
+// its register all the way round a loop, and it is the base
+// for the optimisations which work across a whole function.
+
+#include "data.h"
+#include "arena.h"
+#include "misc.h"
+#include "cfg.h"
+
+static int Setwords;        // Number of ints in each register set
+static struct bblock **Blocks;    // The blocks in order
+static struct insn **Labelinsn;   // The I_LABEL instruction for each label
+static int Nlabelinsn;         // Size of Labelinsn
+
+// Registers read and written by an instruction.
+// There are never more than four of either.
+static int Regsread[4], Regswritten[4];
+static int Nread, Nwritten;
+
+// Return true if the instruction reads its destination
+static int readsdst(int op) {
+  switch (op) {
+    case I_MOV:
+    case I_MOVZB:
+    case I_MOVSL:
+    case I_LEA:
+    case I_SET:
+    case I_POP:
+      return 0;
+  }
+  return 1;
+}
+
+// Return true if the instruction writes its destination
+static int writesdst(int op) {
+  switch (op) {
+    case I_CMP:
+    case I_TEST:
+    case I_PUSH:
+      return 0;
+  }
+  return 1;
+}
+
+static void adduse(int r) {
+  Regsread[Nread] = r;
+  Nread++;
+}
+
+static void adddef(int r) {
+  Regswritten[Nwritten] = r;
+  Nwritten++;
+}
+
+// Find the registers named by an instruction's operands.
+// The base and index registers of a memory operand are
+// always uses.
+static void findregs(struct insn *i) {
+  Nread = Nwritten = 0;
+
+  if (i->src != NULL && (i->src->kind == OT_REG || i->src->kind == OT_MEM))
+    adduse(i->src->reg);
+  if (i->src != NULL && i->src->kind == OT_MEM && i->src->index != NOREG)
+    adduse(i->src->index);
+
+  if (i->dst != NULL) {
+    if (i->dst->kind == OT_MEM)
+      adduse(i->dst->reg);
+    if (i->dst->kind == OT_MEM && i->dst->index != NOREG)
+      adduse(i->dst->index);
+    if (i->dst->kind == OT_REG) {
+      if (readsdst(i->op))
+        adduse(i->dst->reg);
+      if (writesdst(i->op))
+        adddef(i->dst->reg);
+    }
+  }
+}
+
+int insnuses(struct insn *i, int *regs) {
+  int k;
+
+  findregs(i);
+  for (k = 0; k < Nread; k++)
+    regs[k] = Regsread[k];
+  return Nread;
+}
+
+int insndefs(struct insn *i, int *regs) {
+  int k;
+
+  findregs(i);
+  for (k = 0; k < Nwritten; k++)
+    regs[k] = Regswritten[k];
+  return Nwritten;
+}
+
+// Register sets
+
+// Make an empty set of registers
+static int *newset(void) {
+  int *set;
+
+  set = (int *) arenaalloc(Funcarena, Setwords * sizeof(int));
+  return set;
+}
+
+int inset(int *set, int r) {
+  if (r < 0)
+    return 0;
+  return ((set[r >> 5] & (1 << (r & 31))) != 0);
+}
+
+static void addset(int *set, int r) {
+  if (r >= 0)
+    set[r >> 5] = set[r >> 5] | (1 << (r & 31));
+}
+
+// Add the registers in a mask of physical registers to a set
+static void addmask(int *set, int mask) {
+  int r;
+
+  for (r = 0; r < FIRSTVREG; r++)
+    if (mask & (1 << r))
+      addset(set, r);
+}
+
+// Return a mask of the physical registers in a set
+int physmask(int *set) {
+  return (set[0] & ((1 << FIRSTVREG) - 1));
+}
+
+// Building the graph
+
+// Make a new block starting with instruction i
+static struct bblock *mkblock(struct insn *i, int id) {
+  struct bblock *b;
+
+  b = (struct bblock *) arenaalloc(Funcarena, sizeof(struct bblock));
+  b->id = id;
+  b->first = b->last = i;
+  return b;
+}
+
+// Add an edge from block a to block b
+static void addedge(struct bblock *a, struct bblock *b) {
+  struct bblock **list;
+  int n;
+
+  // Don't add the same edge twice
+  for (n = 0; n < a->nsucc; n++)
+    if (a->succ[n] == b)
+      return;
+
+  list = (struct bblock **) arenaalloc(Funcarena,
+                                       (a->nsucc + 1) * sizeof(struct bblock *));
+  for (n = 0; n < a->nsucc; n++)
+    list[n] = a->succ[n];
+  list[n] = b;
+  a->succ = list;
+  a->nsucc = a->nsucc + 1;
+
+  list = (struct bblock **) arenaalloc(Funcarena,
+                                       (b->npred + 1) * sizeof(struct bblock *));
+  for (n = 0; n < b->npred; n++)
+    list[n] = b->pred[n];
+  list[n] = a;
+  b->pred = list;
+  b->npred = b->npred + 1;
+}
+
+// Return the block which starts with the given label
+static struct bblock *labelblock(int label) {
+  if (label < 0 || label >= Nlabelinsn || Labelinsn[label] == NULL)
+    fatald("Jump to unknown label", label);
+  return Blocks[Labelinsn[label]->block];
+}
+
+struct bblock *insnblock(struct insn *i) {
+  return Blocks[i->block];
+}
+
+// Return true if control can go from the
+// instruction to the one after it
+static int fallsthrough(struct insn *i) {
+  return (i->op != I_JMP && i->op != I_TEXT && i->op != I_TAILCALL);
+}
+
+struct bblock *buildcfg(struct insn *head) {
+  struct bblock *first = NULL, *b = NULL, *prev;
+  struct insn *i;
+  int max = 0, id = 0, n, startnew = 1;
+
+  // Cut the instructions into blocks
+  for (i = head; i != NULL; i = i->next) {
+    if (startnew || i->op == I_LABEL) {
+      prev = b;
+      b = mkblock(i, id);
+      id++;
+      b->prev = prev;
+      if (prev != NULL)
+        prev->next = b;
+      else
+        first = b;
+    }
+    b->last = i;
+    i->block = b->id;
+    startnew = (i->op == I_JMP || i->op == I_JCC || i->op == I_TAILCALL);
+
+    if (i->op == I_LABEL && i->dst->val > max)
+      max = i->dst->val;
+  }
+
+  // Index the blocks and the labels
+  Blocks = (struct bblock **) arenaalloc(Funcarena, id * sizeof(struct bblock *));
+  for (b = first; b != NULL; b = b->next)
+    Blocks[b->id] = b;
+  Nlabelinsn = max + 1;
+  Labelinsn = (struct insn **) arenaalloc(Funcarena,
+                                          Nlabelinsn * sizeof(struct insn *));
+  for (i = head; i != NULL; i = i->next)
+    if (i->op == I_LABEL)
+      Labelinsn[i->dst->val] = i;
+
+  // Link the blocks
+  for (b = first; b != NULL; b = b->next) {
+    i = b->last;
+    if ((i->op == I_JMP || i->op == I_JCC) && i->dst->kind == OT_LABEL)
+      addedge(b, labelblock(i->dst->val));
+    if (i->op == I_JMP && i->dst->kind != OT_LABEL)
+      // An indirect jump through a jump table
+      for (n = 0; n < i->ntargets; n++)
+        addedge(b, labelblock(i->targets[n]));
+    if (b->next != NULL && fallsthrough(i))
+      addedge(b, b->next);
+  }
+
+  return first;
+}
+
+// Liveness
+
+// Find the registers that each block reads before writing
+// them, and the ones that it writes
+static void usedef(struct bblock *b) {
+  struct insn *i;
+  int k;
+
+  b->use = newset();
+  b->def = newset();
+  for (i = b->first; i != b->last->next; i = i->next) {
+    findregs(i);
+    for (k = 0; k < Nread; k++)
+      if (!inset(b->def, Regsread[k]))
+        addset(b->use, Regsread[k]);
+    for (k = 0; k < FIRSTVREG; k++)
+      if ((i->impuse & (1 << k)) && !inset(b->def, k))
+        addset(b->use, k);
+    for (k = 0; k < Nwritten; k++)
+      addset(b->def, Regswritten[k]);
+    addmask(b->def, i->impdef);
+  }
+}
+
+void liveness(struct bblock *first, int nregs) {
+  struct bblock *b, *last = NULL;
+  int *newin;
+  int n, w, changed = 1;
+
+  Setwords = (nregs + 31) / 32;
+  for (b = first; b != NULL; b = b->next) {
+    usedef(b);
+    b->livein = newset();
+    b->liveout = newset();
+    last = b;
+  }
+
+  // Work backwards until nothing changes:
+  // out = the union of the successors' ins
+  // in = use + (out - def)
+  newin = newset();
+  while (changed) {
+    changed = 0;
+    for (b = last; b != NULL; b = b->prev) {
+      for (n = 0; n < b->nsucc; n++)
+        for (w = 0; w < Setwords; w++)
+          b->liveout[w] = b->liveout[w] | b->succ[n]->livein[w];
+
+      for (w = 0; w < Setwords; w++) {
+        newin[w] = b->use[w] | (b->liveout[w] & ~b->def[w]);
+        if (newin[w] != b->livein[w]) {
+          b->livein[w] = newin[w];
+          changed = 1;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,18 @@
+// Cut a function's instruction list into basic blocks,
+// link them up and return the first block
+struct bblock *buildcfg(struct insn *head);
+// Return the block holding an instruction
+struct bblock *insnblock(struct insn *i);
+// Work out the registers live in and out of each block.
+// Registers are numbered from zero up to nregs.
+void liveness(struct bblock *first, int nregs);
+// Return true if register r is in the set
+int inset(int *set, int r);
+// Return a mask of the physical registers in a set
+int physmask(int *set);
+// Put the registers an instruction reads into regs[]
+// and return how many there are, at most four
+int insnuses(struct insn *i, int *regs);
+// Put the registers an instruction writes into regs[]
+// and return how many there are, at most four
+int insndefs(struct insn *i, int *regs);
@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "data.h"
+#include "arena.h"
 #include "cg.h"
+#include "flow.h"
 #include "gen.h"
 #include "misc.h"
+#include "peep.h"
+#include "ra.h"
 #include "types.h"
 
 // Flag to say which section were are outputting in to
@@ -11,41 +15,74 @@ enum {
     no_seg, text_seg, data_seg
 } currSeg = no_seg;
 
-#define NUMFREEREGS 4
-#define FIRSTPARAMREG 9   // Position of first parameter register
-
-// List of generic registers that the code will work on
+// Names of the physical registers, in R_ order
 static char *reglist[] =
-        {"%r10", "%r11", "%r12", "%r13", "%r9", "%r8", "%rcx", "%rdx", "%rsi",
-         "%rdi"};
+        {"%rax", "%rbx", "%rcx", "%rdx", "%rsi", "%rdi", "%rbp", "%rsp",
+         "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
 // Lower 8 bits of registers in reglist
 static char *breglist[] =
-        {"%r10b", "%r11b", "%r12b", "%r13b", "%r9b", "%r8b", "%cl", "%dl", "%sil",
-         "%dil"};
+        {"%al", "%bl", "%cl", "%dl", "%sil", "%dil", "%bpl", "%spl",
+         "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"};
 // Lower 4 bytes of registers in reglist
 static char *dreglist[] =
-        {"%r10d", "%r11d", "%r12d", "%r13d", "%r9d", "%r8d", "%ecx", "%edx",
-         "%esi", "%edi"};
+        {"%eax", "%ebx", "%ecx", "%edx", "%esi", "%edi", "%ebp", "%esp",
+         "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+// Registers used to pass the first six arguments
+static int paramreg[] = {R_RDI, R_RSI, R_RDX, R_RCX, R_R8, R_R9};
+
+// Callee-saved registers which we have to preserve
+// if the register allocator hands them out
+static int calleesaved[] = {R_RBX, R_R12, R_R13, R_R14, R_R15};
+#define NUMCALLEESAVED 5
+
+// Bytes below %rsp which a leaf function may use
+// without moving %rsp, the System V red zone
+#define REDZONE 128
 
-// List of available registers
-static int freereg[NUMFREEREGS];
+// Instruction mnemonics, in I_ order. The size suffix and
+// any condition code are appended when printed.
+static char *mnemonic[] = {
+  "", "", "mov", "movzb", "movsl", "lea",
+  "add", "sub", "imul", "and", "or", "xor",
+  "shl", "shr", "sar", "neg", "not", "cmp", "test",
+  "set", "jmp", "j", "call", "cqo", "idiv",
+  "push", "pop", "jmp", "cmov"
+};
 
-// List of comparison instructions corresponding to
-// A_EQ, A_NE, A_LT, A_GT, A_LE, A_GE
-static char *cmplist[] = {"sete", "setne", "setl", "setg", "setle", "setge"};
+// Condition code suffixes, in CC_ order
+static char *cclist[] = {"e", "ne", "l", "g", "le", "ge", "a", "be"};
 
-// List of inverted jump instructions corresponding to
-// A_EQ, A_NE, A_LT, A_GT, A_LE, A_GE
-static char *invcmplist[] = {"jne", "je", "jge", "jle", "jg", "jl"};
+// The inverse of each condition code, in CC_ order
+static int ccinvert[] = {CC_NE, CC_E, CC_GE, CC_LE, CC_G, CC_L, CC_BE, CC_A};
 
 // Position of next local variable relative to stack base pointer
 static int localOffset;
 static int stackOffset;
 
-// Next register to spill on the stack
-// When this value is 0, it means that
-// we have no spilled registers.
-static int spillreg = 0;
+// How the frame is addressed when the function is written out.
+// Offsets are worked out relative to %rbp; without a frame
+// pointer they become offsets from %rsp, moved by Framebias and
+// by what has been pushed for the current call.
+static int Framereg;
+static int Framebias;
+static int Pushdepth;
+
+// Bytes that %rsp is moved down by when there is no frame
+// pointer, and the callee-saved registers which the function
+// uses along with the frame slots they are saved in
+static int Framesize;
+static int Savedregs;
+static int Saveslot[NUMCALLEESAVED];
+
+// Next virtual register to hand out
+static int nextvreg;
+
+// The instruction list for the function being generated.
+// While Codeactive is set, instructions are added to the
+// list instead of being written out to the assembly file.
+static struct insn *Codehead, *Codetail;
+static int Codeactive = 0;
 
 void cgtextseg() {
   if (currSeg != text_seg) {
@@ -61,76 +98,258 @@ void cgdataseg() {
   }
 }
 
-// Mark all registers as available
-// If keepreg is positive, don't free that one
-void freeall_registers(int keepreg) {
-  int i;
-  for (i = 0; i < NUMFREEREGS; i++) {
-    if (i != keepreg)
-      freereg[i] = 1;
-  }
+void cgnoseg(void) {
+  currSeg = no_seg;
 }
 
-// Push a register to the stack
-static void pushreg(int r) {
-  fprintf(Outfile, "\tpushq\t%s\n", reglist[r]);
+// Build and return an instruction operand
+struct operand *cgoperand(int kind, int reg, int size, int val, char *name) {
+  struct operand *o;
+
+  o = (struct operand *) arenaalloc(Funcarena, sizeof(struct operand));
+
+  o->kind = kind;
+  o->reg = reg;
+  o->index = NOREG;
+  o->scale = 1;
+  o->size = size;
+  o->val = val;
+  o->name = name;
+  return o;
 }
 
-// Pop a register off the stack
-static void popreg(int r) {
-  fprintf(Outfile, "\tpopq\t%s\n", reglist[r]);
+// Build and return an instruction which is not yet
+// on any instruction list
+struct insn *cginsn(int op, int size, struct operand *src, struct operand *dst) {
+  struct insn *i;
+
+  // Instructions only live until the end of their function
+  i = (struct insn *) arenaalloc(Funcarena, sizeof(struct insn));
+  i->op = op;
+  i->size = size;
+  i->cc = 0;
+  i->impuse = 0;
+  i->impdef = 0;
+  i->text = NULL;
+  i->targets = NULL;
+  i->ntargets = 0;
+  i->block = 0;
+  i->src = src;
+  i->dst = dst;
+  i->prev = NULL;
+  i->next = NULL;
+  return i;
 }
 
-// Allocate a free register and returns the corresponding
-// identifier. Program exits if no available registers remain.
-int alloc_register(void) {
-  int reg;
+// Shorthands for the common operand kinds
+static struct operand *oreg(int reg, int size) {
+  return cgoperand(OT_REG, reg, size, 0, NULL);
+}
 
-  for (reg = 0; reg < NUMFREEREGS; reg++) {
-    if (freereg[reg]) {
-      freereg[reg] = 0;
-      return reg;
-    }
+static struct operand *oimm(int val) {
+  return cgoperand(OT_IMM, NOREG, 0, val, NULL);
+}
+
+static struct operand *omem(int reg, int disp) {
+  return cgoperand(OT_MEM, reg, 8, disp, NULL);
+}
+
+// Memory operand (base,index,scale)
+static struct operand *omemindex(int reg, int index, int scale) {
+  struct operand *o = cgoperand(OT_MEM, reg, 8, 0, NULL);
+
+  o->index = index;
+  o->scale = scale;
+  return o;
+}
+
+static struct operand *oglob(char *name) {
+  return cgoperand(OT_GLOB, NOREG, 0, 0, name);
+}
+
+static struct operand *olabel(int l) {
+  return cgoperand(OT_LABEL, NOREG, 0, l, NULL);
+}
+
+// Add an instruction to the end of the
+// current function's instruction list
+static struct insn *emit(int op, int size, struct operand *src, struct operand *dst) {
+  struct insn *i = cginsn(op, size, src, dst);
+
+  if (Codetail) {
+    Codetail->next = i;
+    i->prev = Codetail;
+    Codetail = i;
+  } else {
+    Codehead = Codetail = i;
   }
+  return i;
+}
 
-  // Since we've no available registers, we spill one
-  reg = (spillreg % NUMFREEREGS);
-  spillreg++;
-  pushreg(reg);
-  return reg;
+// Return an operand for the memory
+// location that holds a variable
+static struct operand *symaddr(struct symtable *sym) {
+  if (sym->class == C_LOCAL || sym->class == C_PARAM)
+    return omem(R_RBP, sym->st_posn);
+  return oglob(sym->name);
 }
 
-// Frees up a previously allocated register.
-void cgfreereg(int reg) {
-  if (freereg[reg] != 0) {
-    fatald("Error trying to free register", reg);
+// Print out a register with the given size
+static void printreg(int r, int size) {
+  if (r >= FIRSTVREG)
+    fatald("Unallocated virtual register", r);
+
+  switch (size) {
+    case 1:
+      fputs(breglist[r], Outfile);
+      break;
+    case 4:
+      fputs(dreglist[r], Outfile);
+      break;
+    default:
+      fputs(reglist[r], Outfile);
   }
+}
 
-  // If there was a spilled register
-  // Note: We always reload the most recently-spilled register
-  if (spillreg > 0) {
-    spillreg--;
-    reg = (spillreg % NUMFREEREGS);
-    popreg(reg);
-  } else {
-    freereg[reg] = 1;
+static void printoperand(struct operand *o) {
+  switch (o->kind) {
+    case OT_REG:
+      printreg(o->reg, o->size);
+      break;
+    case OT_IMM:
+      fprintf(Outfile, "$%d", o->val);
+      break;
+    case OT_MEM:
+      if (o->reg == R_RBP && Framereg == R_RSP) {
+        fprintf(Outfile, "%d(%%rsp", o->val + Framebias + Pushdepth);
+        if (o->index != NOREG) {
+          fputs(",", Outfile);
+          printreg(o->index, 8);
+          fprintf(Outfile, ",%d", o->scale);
+        }
+        fputs(")", Outfile);
+        break;
+      }
+      if (o->val != 0)
+        fprintf(Outfile, "%d", o->val);
+      fputs("(", Outfile);
+      if (o->reg != NOREG)
+        printreg(o->reg, 8);
+      if (o->index != NOREG) {
+        fputs(",", Outfile);
+        printreg(o->index, 8);
+        fprintf(Outfile, ",%d", o->scale);
+      }
+      fputs(")", Outfile);
+      break;
+    case OT_GLOB:
+      if (o->val != 0)
+        fprintf(Outfile, "%s%+d(%%rip)", o->name, o->val);
+      else
+        fprintf(Outfile, "%s(%%rip)", o->name);
+      break;
+    case OT_LABEL:
+      fprintf(Outfile, "L%d", o->val);
+      break;
+    case OT_LABREF:
+      fprintf(Outfile, "L%d(%%rip)", o->val);
+      break;
+    case OT_SYM:
+      fputs(o->name, Outfile);
+      break;
   }
 }
 
-// Spill all registers on the stack
-void spill_all_regs(void) {
-  int i;
+// Print the operand for a slot in the frame
+static void printslot(int offset) {
+  printoperand(omem(R_RBP, offset));
+}
+
+// Print the code which puts back the callee-saved registers
+// and the caller's frame, ahead of a return or a tail call
+static void printepilogue(void) {
+  int n;
 
-  for (i = 0; i < NUMFREEREGS; i++) {
-    pushreg(i);
+  for (n = 0; n < NUMCALLEESAVED; n++) {
+    if (Savedregs & (1 << calleesaved[n])) {
+      fputs("\tmovq\t", Outfile);
+      printslot(Saveslot[n]);
+      fprintf(Outfile, ", %s\n", reglist[calleesaved[n]]);
+    }
   }
+
+  // Restore stack pointer
+  if (Framereg == R_RBP) {
+    fprintf(Outfile, "\taddq\t$%d, %%rsp\n", stackOffset);
+    fputs("\tpopq %rbp\n", Outfile);
+  } else if (Framesize != 0)
+    fprintf(Outfile, "\taddq\t$%d, %%rsp\n", Framesize);
 }
 
-static void unspill_all_regs(void) {
-  int i;
+// Print out a single machine instruction
+static void printinsn(struct insn *i) {
+  switch (i->op) {
+    case I_LABEL:
+      // Start a loop on a 16-byte boundary,
+      // unless that takes a lot of padding
+      if (i->size != 0)
+        fputs("\t.p2align\t4,,10\n", Outfile);
+      fprintf(Outfile, "L%d:\n", i->dst->val);
+      return;
+    case I_TEXT:
+      fputs(i->text, Outfile);
+      return;
+    case I_TAILCALL:
+      // Leave the function as if returning, and
+      // let the callee return to our caller
+      printepilogue();
+      break;
+  }
+
+  fprintf(Outfile, "\t%s", mnemonic[i->op]);
+  if (i->op == I_SET || i->op == I_JCC || i->op == I_CMOV)
+    fputs(cclist[i->cc], Outfile);
+  switch (i->size) {
+    case 1:
+      fputs("b", Outfile);
+      break;
+    case 4:
+      fputs("l", Outfile);
+      break;
+    case 8:
+      fputs("q", Outfile);
+      break;
+  }
+
+  if (i->src != NULL) {
+    fputs("\t", Outfile);
+    printoperand(i->src);
+    if (i->dst != NULL) {
+      fputs(", ", Outfile);
+      printoperand(i->dst);
+    }
+  } else if (i->dst != NULL) {
+    fputs("\t", Outfile);
+    // Indirect jump, e.g. jmp *(%rdx,%rax,8)
+    if (i->op == I_JMP && (i->dst->kind == OT_REG || i->dst->kind == OT_MEM))
+      fputs("*", Outfile);
+    printoperand(i->dst);
+  }
+  if (i->op == I_CALL || i->op == I_TAILCALL)
+    fputs("@PLT", Outfile);
+  fputs("\n", Outfile);
+
+  // Keep track of %rsp while arguments are on the stack
+  if (i->op == I_PUSH)
+    Pushdepth = Pushdepth + 8;
+  if (i->op == I_ADD && i->dst->kind == OT_REG && i->dst->reg == R_RSP)
+    Pushdepth = Pushdepth - i->src->val;
+}
 
-  for (i = NUMFREEREGS - 1; i >= 0; i--)
-    popreg(i);
+// Allocate a new virtual register and
+// return its identifier
+int alloc_register(void) {
+  return nextvreg++;
 }
 
 static int newlocaloffset(int size) {
@@ -139,93 +358,203 @@ static int newlocaloffset(int size) {
   return -localOffset;
 }
 
+// Allocate an 8-byte aligned slot in the stack
+// frame of the current function and return
+// its offset from the frame pointer
+int cgspillslot(void) {
+  localOffset = (localOffset + 7) & ~7;
+  return newlocaloffset(8);
+}
+
 void cgpreamble() {
-  freeall_registers(NOREG);
   cgtextseg();
-  fprintf(Outfile,
-          "# internal switch(expr) routine\n"
-          "# %%rsi = switch table, %%rax = expr\n"
-          "# from SubC: http://www.t3x.org/subc/\n"
-          "\n"
-          "__switch:\n"
-          "        pushq   %%rsi\n"
-          "        movq    %%rdx, %%rsi\n"
-          "        movq    %%rax, %%rbx\n"
-          "        cld\n"
-          "        lodsq\n"
-          "        movq    %%rax, %%rcx\n"
-          "__next:\n"
-          "        lodsq\n"
-          "        movq    %%rax, %%rdx\n"
-          "        lodsq\n"
-          "        cmpq    %%rdx, %%rbx\n"
-          "        jnz     __no\n"
-          "        popq    %%rsi\n"
-          "        jmp     *%%rax\n"
-          "__no:\n"
-          "        loop    __next\n"
-          "        lodsq\n"
-          "        popq    %%rsi\n"
-          "        jmp     *%%rax\n"
-          "\n");
 }
 
+// Return true if the local or param is a scalar whose address
+// is never taken, so it can live in a register for the whole
+// function
+static int inregister(struct symtable *sym) {
+  if (sym->stype != S_VARIABLE || sym->st_addrtaken)
+    return 0;
+  return (inttype(sym->type) || ptrtype(sym->type));
+}
+
+// Load a variable from memory into register r, widened to 64 bits
+static void loadinto(struct symtable *sym, int r) {
+  switch (sym->size) {
+    case 1:
+      emit(I_MOVZB, 8, symaddr(sym), oreg(r, 8));
+      break;
+    case 4:
+      emit(I_MOVSL, 8, symaddr(sym), oreg(r, 8));
+      break;
+    case 8:
+      emit(I_MOV, 8, symaddr(sym), oreg(r, 8));
+  }
+}
+
+// Load a param passed on the stack into a new register
+static int loadslot(struct symtable *sym) {
+  int r = alloc_register();
+
+  loadinto(sym, r);
+  return r;
+}
+
+// Start the code for a function. We work out where
+// the parameters and locals live on the stack, but
+// the function's instructions are collected in a
+// list and only written out by cgfuncpostamble()
+// once the registers have been allocated.
 void cgfuncpreamble(struct symtable *sym) {
-  char *name = sym->name;
   struct symtable *parm, *locvar;
   int cnt;
   int paramOffset = 16;           // Offset of first param (relative to %rbp)
-  int paramReg = FIRSTPARAMREG;   // Index to first param register
 
-  // Generate output in text segment
-  cgtextseg();
-  // Reset offset
+  // Reset offset and start a new instruction list
   localOffset = 0;
+  nextvreg = FIRSTVREG;
+  Codehead = Codetail = NULL;
+  Codeactive = 1;
 
-  // Output the function start, save the %rsp and %rsp
-  if (sym->class == C_GLOBAL)
-    fprintf(Outfile, "\t.globl\t%s\n"
-                     "\t.type\t%s, @function\n", name, name);
-
-  fprintf(Outfile,
-          "%s:\n" "\tpushq\t%%rbp\n"
-          "\tmovq\t%%rsp, %%rbp\n", name);
-
-  // Copy in-register parameters to the stack
+  // Copy in-register parameters to the stack, or
+  // to their own virtual registers
   for (parm = sym->member, cnt = 1; parm != NULL; parm = parm->next, cnt++) {
+    parm->st_reg = NOREG;
     // Only 6 params are passed in registers
     if (cnt > 6) {
       parm->st_posn = paramOffset;
       paramOffset += 8;
+      if (inregister(parm)) {
+        parm->st_reg = alloc_register();
+        cgstorlocal(loadslot(parm), parm);
+      }
     } else {
-      parm->st_posn = newlocaloffset(parm->size);
-      cgstorlocal(paramReg--, parm);
+      if (inregister(parm))
+        parm->st_reg = alloc_register();
+      else
+        parm->st_posn = newlocaloffset(parm->size);
+      cgstorlocal(paramreg[cnt - 1], parm);
     }
   }
 
   // For locals, we shall create a new
-  // stack position.
+  // stack position or virtual register.
   for (locvar = Loclhead; locvar != NULL; locvar = locvar->next) {
-    locvar->st_posn = newlocaloffset(locvar->size);
+    locvar->st_reg = NOREG;
+    if (inregister(locvar))
+      locvar->st_reg = alloc_register();
+    else
+      locvar->st_posn = newlocaloffset(locvar->size);
   }
+}
 
-  // Align stack pointer to be a multiple of 16
-  stackOffset = (localOffset + 15) & ~15;
-  // Decrement stack pointer based on how many
-  // variables we loaded onto the stack
-  fprintf(Outfile, "\taddq\t$%d, %%rsp\n", -stackOffset);
+// Return a mask of the callee-saved registers
+// used by the current function's instructions
+static int calleesavedused(void) {
+  struct insn *i;
+  int mask = 0, used = 0, n;
+
+  for (i = Codehead; i != NULL; i = i->next) {
+    mask = mask | i->impdef;
+    if (i->src != NULL && (i->src->kind == OT_REG || i->src->kind == OT_MEM))
+      mask = mask | (1 << i->src->reg);
+    if (i->dst != NULL && (i->dst->kind == OT_REG || i->dst->kind == OT_MEM))
+      mask = mask | (1 << i->dst->reg);
+  }
+
+  for (n = 0; n < NUMCALLEESAVED; n++)
+    used = used | (mask & (1 << calleesaved[n]));
+  return used;
+}
+
+// Return true if the function's instructions make no calls
+static int isleaf(void) {
+  struct insn *i;
+
+  for (i = Codehead; i != NULL; i = i->next)
+    if (i->op == I_CALL)
+      return 0;
+  return 1;
 }
 
+// Finish the code for a function: allocate registers,
+// then write out the function with its prologue
+// and epilogue.
 void cgfuncpostamble(struct symtable *sym) {
+  char *name = sym->name;
+  struct insn *i;
+  int spills, n;
+
   cglabel(sym->st_endlabel);
-  // Restore stack pointer
-  fprintf(Outfile, "\taddq\t$%d, %%rsp\n", stackOffset);
-  fputs(
-          "\tpopq %rbp\n"
-          "\tret\n",
-          Outfile
-  );
-  freeall_registers(NOREG);
+  Codeactive = 0;
+
+  flowopt(&Codehead, nextvreg);
+  spills = regalloc(&Codehead, nextvreg);
+  if (O_verbose)
+    printf("  %s: %d virtual registers, %d spill instructions\n",
+           name, nextvreg - FIRSTVREG, spills);
+  peephole(&Codehead);
+
+  // Give each callee-saved register that we use
+  // a slot in the frame to be saved in
+  Savedregs = calleesavedused();
+  for (n = 0; n < NUMCALLEESAVED; n++)
+    if (Savedregs & (1 << calleesaved[n]))
+      Saveslot[n] = cgspillslot();
+
+  cgtextseg();
+
+  // Output the function start, save the %rsp and %rsp
+  if (sym->class == C_GLOBAL)
+    fprintf(Outfile, "\t.globl\t%s\n"
+                     "\t.type\t%s, @function\n", name, name);
+
+  // Align stack pointer to be a multiple of 16
+  stackOffset = (localOffset + 15) & ~15;
+
+  // A leaf function whose frame fits in the red zone doesn't
+  // need one: its locals are addressed below %rsp. With
+  // -fomit-frame-pointer, other functions move %rsp down once
+  // and address their locals from it. Either way, an offset d
+  // from where %rbp would be is d + framesize - 8 from %rsp.
+  Framereg = R_RBP;
+  Pushdepth = Framesize = 0;
+  if (isleaf() && localOffset <= REDZONE - 8) {
+    Framereg = R_RSP;
+    Framesize = 0;
+  } else if (O_omitfp) {
+    Framereg = R_RSP;
+    // Keep %rsp 16-byte aligned at calls
+    Framesize = stackOffset + 8;
+  }
+  Framebias = Framesize - 8;
+
+  fprintf(Outfile, "%s:\n", name);
+  if (Framereg == R_RBP) {
+    fputs("\tpushq\t%rbp\n" "\tmovq\t%rsp, %rbp\n", Outfile);
+    // Decrement stack pointer based on how many
+    // variables we loaded onto the stack
+    fprintf(Outfile, "\taddq\t$%d, %%rsp\n", -stackOffset);
+  } else if (Framesize != 0)
+    fprintf(Outfile, "\taddq\t$%d, %%rsp\n", -Framesize);
+
+  for (n = 0; n < NUMCALLEESAVED; n++) {
+    if (Savedregs & (1 << calleesaved[n])) {
+      fprintf(Outfile, "\tmovq\t%s, ", reglist[calleesaved[n]]);
+      printslot(Saveslot[n]);
+      fputs("\n", Outfile);
+    }
+  }
+
+  // The function body ends with its end label
+  for (i = Codehead; i != NULL; i = i->next)
+    printinsn(i);
+
+  printepilogue();
+  fputs("\tret\n", Outfile);
+  Framereg = R_RBP;
+  Codehead = Codetail = NULL;
 }
 
 void cgpostamble() {}
@@ -236,76 +565,224 @@ int cgloadint(int value, int type) {
   int r = alloc_register();
 
   // e.g. movq 10, %r10
-  fprintf(Outfile, "\tmovq\t$%d, %s\n", value, reglist[r]);
+  emit(I_MOV, 8, oimm(value), oreg(r, 8));
 
   return r;
 }
 
-// Adds two registers and saves the result in one of them
-// while freeing the other.
+// Adds two registers and saves the result in the first one
 int cgadd(int r1, int r2) {
   // e.g. addq %r8, %r9
-  fprintf(Outfile, "\taddq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_ADD, 8, oreg(r2, 8), oreg(r1, 8));
 
   return r1;
 }
 
-// Multiplies two registers and saves the result in one of them
-// while freeing the other.
+// Multiplies two registers and saves the result in the first one
 int cgmul(int r1, int r2) {
   // e.g. imulq %r8, %r9
-  fprintf(Outfile, "\timulq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_IMUL, 8, oreg(r2, 8), oreg(r1, 8));
 
   return r1;
 }
 
 // Subtracts the second register from the first and returns
-// the register with the result while freeing the other.
+// the register with the result.
 int cgsub(int r1, int r2) {
   // e.g. subq %r2, %r1
-  fprintf(Outfile, "\tsubq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_SUB, 8, oreg(r2, 8), oreg(r1, 8));
 
   return r1;
 }
 
-// Divide first register by the second and returns the
-// register containing the result while freeing the other.
+// Divide first register by the second and return a
+// register containing the quotient or the remainder.
 int cgdivmod(int r1, int r2, int op) {
+  struct insn *i;
+  int r = alloc_register();
+
   // Move dividend to %rax
   // e.g. movq %r1, %rax
-  fprintf(Outfile, "\tmovq\t%s, %%rax\n", reglist[r1]);
+  emit(I_MOV, 8, oreg(r1, 8), oreg(R_RAX, 8));
 
   // Extend dividend to 8 bytes
   // e.g. cqo
-  fprintf(Outfile, "\tcqo\n");
+  i = emit(I_CQO, 0, NULL, NULL);
+  i->impuse = (1 << R_RAX);
+  i->impdef = (1 << R_RDX);
 
   // Divide the dividend in rax with the divisor in r2,
   // the resulting quotient will be in %rax
   // e.g. idivq %r2
-  fprintf(Outfile, "\tidivq\t%s\n", reglist[r2]);
+  i = emit(I_IDIV, 8, oreg(r2, 8), NULL);
+  i->impuse = (1 << R_RAX) | (1 << R_RDX);
+  i->impdef = (1 << R_RAX) | (1 << R_RDX);
 
   if (op == A_DIVIDE)
-    // Move result from %rax to %r1
+    // Move result from %rax
     // e.g. movq %rax, %r1
-    fprintf(Outfile, "\tmovq\t%%rax, %s\n", reglist[r1]);
+    emit(I_MOV, 8, oreg(R_RAX, 8), oreg(r, 8));
   else
-    fprintf(Outfile, "\tmovq\t%%rdx,%s\n", reglist[r1]);
+    emit(I_MOV, 8, oreg(R_RDX, 8), oreg(r, 8));
 
-  cgfreereg(r2);
+  return r;
+}
 
-  return r1;
+static long Magic;              // Multiplier for division by a constant
+static int Magicshift;          // and the shift which follows it
+
+// Work out Magic and Magicshift for signed 32-bit division by
+// d >= 2, as in Hacker's Delight: x / d is the top half of
+// x * Magic shifted right by Magicshift, plus one if x < 0.
+// Magic is below 2^32, and the arithmetic is unsigned 32-bit.
+static void divmagic(int d) {
+  long two31, mask, anc, q1, r1, q2, r2, delta;
+  int p, more;
+
+  two31 = 1;
+  two31 = two31 << 31;
+  mask = two31 + two31 - 1;
+  anc = two31 - 1 - two31 % d;
+  p = 31;
+  q1 = two31 / anc;
+  r1 = two31 - q1 * anc;
+  q2 = two31 / d;
+  r2 = two31 - q2 * d;
+  more = 1;
+  while (more) {
+    p++;
+    q1 = (2 * q1) & mask;
+    r1 = (2 * r1) & mask;
+    if (r1 >= anc) {
+      q1++;
+      r1 = r1 - anc;
+    }
+    q2 = (2 * q2) & mask;
+    r2 = (2 * r2) & mask;
+    if (r2 >= d) {
+      q2++;
+      r2 = r2 - d;
+    }
+    delta = d - r2;
+    more = 0;
+    if (q1 < delta || (q1 == delta && r1 == 0))
+      more = 1;
+  }
+  Magic = (q2 + 1) & mask;
+  Magicshift = p - 32;
+}
+
+// Return k if val is 2 to the power k, else -1
+static int log2const(int val) {
+  int k = 0;
+
+  if (val < 2 || (val & (val - 1)) != 0)
+    return -1;
+  while (val > 1) {
+    val = val >> 1;
+    k++;
+  }
+  return k;
+}
+
+// Return a new register holding a copy of register r
+static int copyreg(int r) {
+  int t = alloc_register();
+
+  emit(I_MOV, 8, oreg(r, 8), oreg(t, 8));
+  return t;
+}
+
+int cgdivconst(int r, int val, int op, int type) {
+  long two31;
+  int d, k, m, q, t;
+
+  d = val;
+  if (d < 0)
+    d = -d;
+  // This also turns away the most negative int
+  if (d < 2)
+    return NOREG;
+  k = log2const(d);
+
+  if (cgprimsize(type) != 8) {
+    // The int may have overflowed its 32 bits
+    // e.g. movslq %r10d, %r10
+    emit(I_MOVSL, 8, oreg(r, 4), oreg(r, 8));
+  } else if (k < 0 || k > 31)
+    return NOREG;
+
+  if (k >= 0) {
+    // Round a negative x towards zero by adding d - 1,
+    // i.e. the top k bits of x >> 63, before shifting
+    t = copyreg(r);
+    emit(I_SAR, 8, oimm(63), oreg(t, 8));
+    emit(I_SHR, 8, oimm(64 - k), oreg(t, 8));
+    emit(I_ADD, 8, oreg(r, 8), oreg(t, 8));
+    if (op == A_MOD) {
+      // x - (rounded x & -d)
+      emit(I_AND, 8, oimm(-d), oreg(t, 8));
+      emit(I_SUB, 8, oreg(t, 8), oreg(r, 8));
+      return r;
+    }
+    emit(I_SAR, 8, oimm(k), oreg(t, 8));
+    q = t;
+  } else {
+    // x * Magic fits in 64 bits. A Magic of 2^31 or more
+    // doesn't fit an immediate, so we multiply by
+    // Magic - 2^32 and add back x << 32.
+    divmagic(d);
+    two31 = 1;
+    two31 = two31 << 31;
+    q = copyreg(r);
+    if (Magic >= two31) {
+      m = (int) (Magic - two31 - two31);
+      emit(I_IMUL, 8, oimm(m), oreg(q, 8));
+      t = copyreg(r);
+      emit(I_SHL, 8, oimm(32), oreg(t, 8));
+      emit(I_ADD, 8, oreg(t, 8), oreg(q, 8));
+    } else {
+      m = (int) Magic;
+      emit(I_IMUL, 8, oimm(m), oreg(q, 8));
+    }
+    emit(I_SAR, 8, oimm(32 + Magicshift), oreg(q, 8));
+    // Subtracting x >> 63 adds one if x is negative
+    t = copyreg(r);
+    emit(I_SAR, 8, oimm(63), oreg(t, 8));
+    emit(I_SUB, 8, oreg(t, 8), oreg(q, 8));
+    if (op == A_MOD) {
+      // x - (x / d) * d, which takes its sign from x
+      emit(I_IMUL, 8, oimm(d), oreg(q, 8));
+      emit(I_SUB, 8, oreg(q, 8), oreg(r, 8));
+      return r;
+    }
+  }
+
+  if (val < 0)
+    emit(I_NEG, 8, NULL, oreg(q, 8));
+  return q;
+}
+
+// Mask of the registers that a function call may change
+static int callerclobbered(void) {
+  int mask;
+
+  mask = (1 << R_RAX) | (1 << R_RCX) | (1 << R_RDX) | (1 << R_RSI) |
+         (1 << R_RDI) | (1 << R_R8) | (1 << R_R9) | (1 << R_R10) |
+         (1 << R_R11);
+  return mask;
 }
 
 // Calls the printint function in the preamble to
 // print an integer
 void cgprintint(int r) {
+  struct insn *i;
+
   // Linux x86-64 expects the first argument to be in %rdi
-  fprintf(Outfile, "\tmovq\t%s, %%rdi\n", reglist[r]);
-  fprintf(Outfile, "\tcall\tprintint\n");
-  cgfreereg(r);
+  emit(I_MOV, 8, oreg(r, 8), oreg(R_RDI, 8));
+  i = emit(I_CALL, 0, NULL, cgoperand(OT_SYM, NOREG, 0, 0, "printint"));
+  i->impuse = (1 << R_RDI);
+  i->impdef = callerclobbered();
 }
 
 int cgstorglob(int r, struct symtable *sym) {
@@ -313,15 +790,15 @@ int cgstorglob(int r, struct symtable *sym) {
     case 1:
       // Only move a single byte for chars
       // e.g. movb %r10b, identifier(%rip)
-      fprintf(Outfile, "\tmovb\t%s, %s(%%rip)\n", breglist[r], sym->name);
+      emit(I_MOV, 1, oreg(r, 1), oglob(sym->name));
       break;
     case 4:
       // e.g. movl %r10d, identifier(%rip)
-      fprintf(Outfile, "\tmovl\t%s, %s(%%rip)\n", dreglist[r], sym->name);
+      emit(I_MOV, 4, oreg(r, 4), oglob(sym->name));
       break;
     case 8:
       // e.g. movq %r10, identifier(%rip)
-      fprintf(Outfile, "\tmovq\t%s, %s(%%rip)\n", reglist[r], sym->name);
+      emit(I_MOV, 8, oreg(r, 8), oglob(sym->name));
       break;
     default:
       fatald("Bad type in cgloadglob", sym->type);
@@ -386,70 +863,89 @@ void cgglobsym(struct symtable *sym) {
   }
 }
 
-int cgcompare_and_set(int ASTop, int r1, int r2, int type) {
+// Compare two registers of the given type
+static void cgcompare(int r1, int r2, int type) {
   int size = cgprimsize(type);
 
+  // cmpq %r2, %r1
+  // This calculates %r1 - %r2
+  if (size != 1 && size != 4)
+    size = 8;
+  emit(I_CMP, size, oreg(r2, size), oreg(r1, size));
+}
+
+int cgcompare_and_set(int ASTop, int r1, int r2, int type) {
+  struct insn *i;
+
   if (ASTop < A_EQ || ASTop > A_GE)
     fatal("Bad ASTop in cgcompare_and_set()");
 
-  switch (size) {
-    // cmpq %r2, %r1
-    // This calculates %r1 - %r2
-    case 1:
-      fprintf(Outfile, "\tcmpb\t%s, %s\n", breglist[r2], breglist[r1]);
-      break;
-    case 4:
-      fprintf(Outfile, "\tcmpl\t%s, %s\n", dreglist[r2], dreglist[r1]);
-      break;
-    default:
-      fprintf(Outfile, "\tcmpq\t%s, %s\n", reglist[r2], reglist[r1]);
-  }
+  cgcompare(r1, r2, type);
 
   // setge %r10b
   // This only sets the lowest byte of the register
   // Note: These instructions only works on 8-bit registers
-  fprintf(Outfile, "\t%s\t%s\n", cmplist[ASTop - A_EQ], breglist[r2]);
+  i = emit(I_SET, 0, NULL, oreg(r2, 1));
+  i->cc = ASTop - A_EQ;
   // movzbq %r10b, %r10
   // Moves the lowest bytes from one register and extends it to fill
   // a 64-bit register
-  fprintf(Outfile, "\tmovzbq\t%s, %s\n", breglist[r2], reglist[r2]);
+  emit(I_MOVZB, 8, oreg(r2, 1), oreg(r2, 8));
 
-  cgfreereg(r1);
   return r2;
 }
 
+int cgcompare_and_select(int ASTop, int r1, int r2, int rtrue, int rfalse,
+                         int type) {
+  struct insn *i;
+  int r = alloc_register();
+
+  if (ASTop < A_EQ || ASTop > A_GE)
+    fatal("Bad ASTop in cgcompare_and_select()");
+
+  // movq %rfalse, %r
+  // cmpq %r2, %r1
+  // cmovlq %rtrue, %r
+  // The move leaves the flags alone, and the
+  // conditional move only happens if r1 < r2
+  cgmove(rfalse, r);
+  cgcompare(r1, r2, type);
+  i = emit(I_CMOV, 8, oreg(rtrue, 8), oreg(r, 8));
+  i->cc = ASTop - A_EQ;
+  return r;
+}
+
 void cglabel(int l) {
   // L1:
-  fprintf(Outfile, "L%d:\n", l);
+  if (Codeactive)
+    emit(I_LABEL, 0, NULL, olabel(l));
+  else
+    fprintf(Outfile, "L%d:\n", l);
+}
+
+void cglooplabel(int l) {
+  struct insn *i;
+
+  i = emit(I_LABEL, 0, NULL, olabel(l));
+  i->size = 1;
 }
 
 void cgjump(int l) {
   // jmp L1
-  fprintf(Outfile, "\tjmp\tL%d\n", l);
+  emit(I_JMP, 0, NULL, olabel(l));
 }
 
 int cgcompare_and_jump(int ASTop, int r1, int r2, int label, int type) {
-  int size = cgprimsize(type);
+  struct insn *i;
 
   if (ASTop < A_EQ || ASTop > A_GE)
     fatal("Bad ASTop in cgcompare_and_jump()");
 
-  switch (size) {
-    // cmpq %r2, %r1
-    case 1:
-      fprintf(Outfile, "\tcmpb\t%s, %s\n", breglist[r2], breglist[r1]);
-      break;
-    case 4:
-      fprintf(Outfile, "\tcmpl\t%s, %s\n", dreglist[r2], dreglist[r1]);
-      break;
-    default:
-      fprintf(Outfile, "\tcmpq\t%s, %s\n", reglist[r2], reglist[r1]);
-  }
+  cgcompare(r1, r2, type);
 
   // jne L1
-  fprintf(Outfile, "\t%s\tL%d\n", invcmplist[ASTop - A_EQ], label);
-  cgfreereg(r1);
-  cgfreereg(r2);
+  i = emit(I_JCC, 0, NULL, olabel(label));
+  i->cc = ccinvert[ASTop - A_EQ];
   return NOREG;
 }
 
@@ -480,42 +976,56 @@ int cgprimsize(int type) {
 }
 
 int cgcall(struct symtable *sym, int numargs) {
-  int outr;
+  struct insn *i;
+  int outr, n;
 
   // call funcname
-  fprintf(Outfile, "\tcall\t%s@PLT\n", sym->name);
+  i = emit(I_CALL, 0, NULL, cgoperand(OT_SYM, NOREG, 0, 0, sym->name));
+  for (n = 0; n < numargs && n < 6; n++)
+    i->impuse = i->impuse | (1 << paramreg[n]);
+  i->impdef = callerclobbered();
 
   // Remove arguments pushed to the stack
   if (numargs > 6)
     // addq $16, %rsp
-    fprintf(Outfile, "\taddq\t$%d, %%rsp\n", 8 * (numargs - 6));
-
-  unspill_all_regs();
+    emit(I_ADD, 8, oimm(8 * (numargs - 6)), oreg(R_RSP, 8));
 
   outr = alloc_register();
   // Move return code from %rax
   // movq %rax, %r9
-  fprintf(Outfile, "\tmovq\t%%rax, %s\n", reglist[outr]);
+  emit(I_MOV, 8, oreg(R_RAX, 8), oreg(outr, 8));
 
   return outr;
 }
 
+void cgtailcall(struct symtable *sym, int numargs) {
+  struct insn *i;
+  int n;
+
+  // jmp funcname, once the frame is gone
+  i = emit(I_TAILCALL, 0, NULL, cgoperand(OT_SYM, NOREG, 0, 0, sym->name));
+  for (n = 0; n < numargs; n++)
+    i->impuse = i->impuse | (1 << paramreg[n]);
+}
+
 void cgreturn(int reg, struct symtable *sym) {
+  struct insn *i;
+
   // If there is a register containing the return value
   if (reg != NOREG) {
     if (ptrtype(sym->type))
-      fprintf(Outfile, "\tmovq\t%s, %%rax\n", reglist[reg]);
+      emit(I_MOV, 8, oreg(reg, 8), oreg(R_RAX, 8));
     else {
       // Move return value to %rax
       switch (sym->type) {
         case P_CHAR:
-          fprintf(Outfile, "\tmovzbl\t%s, %%eax\n", breglist[reg]);
+          emit(I_MOVZB, 4, oreg(reg, 1), oreg(R_RAX, 4));
           break;
         case P_INT:
-          fprintf(Outfile, "\tmovl\t%s, %%eax\n", dreglist[reg]);
+          emit(I_MOV, 4, oreg(reg, 4), oreg(R_RAX, 4));
           break;
         case P_LONG:
-          fprintf(Outfile, "\tmovq\t%s, %%rax\n", reglist[reg]);
+          emit(I_MOV, 8, oreg(reg, 8), oreg(R_RAX, 8));
           break;
         default:
           fatald("Bad function type in cgreturn", sym->type);
@@ -523,18 +1033,19 @@ void cgreturn(int reg, struct symtable *sym) {
     }
   }
 
-  cgjump(sym->st_endlabel);
+  // The return value in %rax is live until we
+  // reach the function's epilogue
+  i = emit(I_JMP, 0, NULL, olabel(sym->st_endlabel));
+  if (reg != NOREG)
+    i->impuse = (1 << R_RAX);
 }
 
 int cgaddress(struct symtable *sym) {
   int r = alloc_register();
 
-  if (sym->class == C_GLOBAL || sym->class == C_STATIC || sym->class == C_EXTERN)
-    // leaq varname(%rip), %r10
-    fprintf(Outfile, "\tleaq\t%s(%%rip), %s\n", sym->name, reglist[r]);
-  else
-    // leaq -8(%rbp), %r10
-    fprintf(Outfile, "\tleaq\t%d(%%rbp), %s\n", sym->st_posn, reglist[r]);
+  // leaq varname(%rip), %r10 or
+  // leaq -8(%rbp), %r10
+  emit(I_LEA, 8, symaddr(sym), oreg(r, 8));
 
   return r;
 }
@@ -542,28 +1053,41 @@ int cgaddress(struct symtable *sym) {
 int cgderef(int r, int type) {
   int newtype = value_at(type);
   int size = cgprimsize(newtype);
+  int outr = alloc_register();
 
+  // The value goes in a new register, so that the address
+  // can be folded into the load's memory operand
   switch (size) {
     case 1:
-      // movzbq (%r10), r10
-      fprintf(Outfile, "\tmovzbq\t(%s), %s\n", reglist[r], reglist[r]);
+      // movzbq (%r10), r11
+      emit(I_MOVZB, 8, omem(r, 0), oreg(outr, 8));
       break;
     case 4:
-      // movslq (%r10), r10
-      fprintf(Outfile, "\tmovslq\t(%s), %s\n", reglist[r], reglist[r]);
+      // movslq (%r10), r11
+      emit(I_MOVSL, 8, omem(r, 0), oreg(outr, 8));
       break;
     case 8:
-      // movq (%r10), r10
-      fprintf(Outfile, "\tmovq\t(%s), %s\n", reglist[r], reglist[r]);
+      // movq (%r10), r11
+      emit(I_MOV, 8, omem(r, 0), oreg(outr, 8));
       break;
   }
 
+  return outr;
+}
+
+int cglea(int base, int index, int scale, int disp) {
+  struct operand *o = omemindex(base, index, scale);
+  int r = alloc_register();
+
+  // leaq 8(%r10,%r11,4), %r12
+  o->val = disp;
+  emit(I_LEA, 8, o, oreg(r, 8));
   return r;
 }
 
 int cgshlconst(int r, int val) {
   // salq $2, %r10
-  fprintf(Outfile, "\tsalq\t$%d, %s\n", val, reglist[r]);
+  emit(I_SHL, 8, oimm(val), oreg(r, 8));
   return r;
 }
 
@@ -573,13 +1097,9 @@ int cgstorderef(int r1, int r2, int type) {
   // movq %r8, (%r10)
   switch (size) {
     case 1:
-      fprintf(Outfile, "\tmovb\t%s, (%s)\n", breglist[r1], reglist[r2]);
-      break;
     case 4:
-      fprintf(Outfile, "\tmovl\t%s, (%s)\n", dreglist[r1], reglist[r2]);
-      break;
     case 8:
-      fprintf(Outfile, "\tmovq\t%s, (%s)\n", reglist[r1], reglist[r2]);
+      emit(I_MOV, size, oreg(r1, size), omem(r2, 0));
       break;
     default:
       fatald("Can't cgstoderef on type", type);
@@ -606,64 +1126,63 @@ void cgglobstrend(void) {
 int cgloadglobstr(int label) {
   int r = alloc_register();
   // leaq L2(%%rip), %r10
-  fprintf(Outfile, "\tleaq\tL%d(%%rip), %s\n", label, reglist[r]);
+  emit(I_LEA, 8, cgoperand(OT_LABREF, NOREG, 0, label, NULL), oreg(r, 8));
   return r;
 }
 
 int cgand(int r1, int r2) {
   // andq %r9, %r10
-  fprintf(Outfile, "\tandq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_AND, 8, oreg(r2, 8), oreg(r1, 8));
   return r1;
 }
 
 int cgor(int r1, int r2) {
   // orq %r9, %r10
-  fprintf(Outfile, "\torq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_OR, 8, oreg(r2, 8), oreg(r1, 8));
   return r1;
 }
 
 int cgxor(int r1, int r2) {
   // xorq %r9, %r10
-  fprintf(Outfile, "\txorq\t%s, %s\n", reglist[r2], reglist[r1]);
-  cgfreereg(r2);
+  emit(I_XOR, 8, oreg(r2, 8), oreg(r1, 8));
   return r1;
 }
 
 // Negate a register's value
 int cgnegate(int r) {
   // negq %r10
-  fprintf(Outfile, "\tnegq\t%s\n", reglist[r]);
+  emit(I_NEG, 8, NULL, oreg(r, 8));
   return r;
 }
 
 // Invert a register's value
 int cginvert(int r) {
   // notq %r10
-  fprintf(Outfile, "\tnotq\t%s\n", reglist[r]);
+  emit(I_NOT, 8, NULL, oreg(r, 8));
   return r;
 }
 
 int cgshl(int r1, int r2) {
   // Amount to shift by has to be loaded in %cl
-  fprintf(Outfile, "\tmovb\t%s, %%cl\n", breglist[r2]);
-  fprintf(Outfile, "\tshlq\t%%cl, %s\n", reglist[r1]);
-
-  cgfreereg(r2);
+  emit(I_MOV, 1, oreg(r2, 1), oreg(R_RCX, 1));
+  emit(I_SHL, 8, oreg(R_RCX, 1), oreg(r1, 8));
   return r1;
 }
 
-int cgshr(int r1, int r2) {
+int cgshr(int r1, int r2, int type) {
   // Amount to shift by has to be loaded in %cl
-  fprintf(Outfile, "\tmovb\t%s, %%cl\n", breglist[r2]);
-  fprintf(Outfile, "\tshrq\t%%cl, %s\n", reglist[r1]);
-
-  cgfreereg(r2);
+  emit(I_MOV, 1, oreg(r2, 1), oreg(R_RCX, 1));
+  // Our chars are unsigned, everything else is signed
+  if (type == P_CHAR)
+    emit(I_SHR, 8, oreg(R_RCX, 1), oreg(r1, 8));
+  else
+    emit(I_SAR, 8, oreg(R_RCX, 1), oreg(r1, 8));
   return r1;
 }
 
 int cglognot(int r) {
+  struct insn *i;
+
   // AND the register with itself to set the zero
   // flag
   //    test %r9, %r9
@@ -673,48 +1192,65 @@ int cglognot(int r) {
   //
   // Move result to final destination
   //    movzbq %r9b, %r9
-  fprintf(Outfile, "\ttest\t%s, %s\n", reglist[r], reglist[r]);
-  fprintf(Outfile, "\tsete\t%s\n", breglist[r]);
-  fprintf(Outfile, "\tmovzbq\t%s, %s\n", breglist[r], reglist[r]);
+  emit(I_TEST, 8, oreg(r, 8), oreg(r, 8));
+  i = emit(I_SET, 0, NULL, oreg(r, 1));
+  i->cc = CC_E;
+  emit(I_MOVZB, 8, oreg(r, 1), oreg(r, 8));
 
   return r;
 }
 
 int cgboolean(int r, int op, int label) {
-  fprintf(Outfile, "\ttest\t%s, %s\n", reglist[r], reglist[r]);
+  struct insn *i;
+
+  emit(I_TEST, 8, oreg(r, 8), oreg(r, 8));
   switch (op) {
     case A_IF:
     case A_WHILE:
     case A_LOGAND:
-      fprintf(Outfile, "\tje\tL%d\n", label);
+      i = emit(I_JCC, 0, NULL, olabel(label));
+      i->cc = CC_E;
       break;
     case A_LOGOR:
-      fprintf(Outfile, "\tjne\tL%d\n", label);
+      i = emit(I_JCC, 0, NULL, olabel(label));
+      i->cc = CC_NE;
       break;
     default:
       // Set if test is not-zero
       // setnz %r9b
       // movzbq %r9b, %r9
-      fprintf(Outfile, "\tsetnz\t%s\n", breglist[r]);
-      fprintf(Outfile, "\tmovzbq\t%s, %s\n", breglist[r], reglist[r]);
+      i = emit(I_SET, 0, NULL, oreg(r, 1));
+      i->cc = CC_NE;
+      emit(I_MOVZB, 8, oreg(r, 1), oreg(r, 8));
   }
 
   return r;
 }
 
 int cgstorlocal(int r, struct symtable *sym) {
-  switch (cgprimsize(sym->type)) {
+  int size = cgprimsize(sym->type);
+
+  // A variable kept in a register holds its value
+  // widened to 64 bits, as it would be when loaded
+  if (sym->st_reg != NOREG) {
+    switch (size) {
+      case 1:
+        emit(I_MOVZB, 8, oreg(r, 1), oreg(sym->st_reg, 8));
+        break;
+      case 4:
+        emit(I_MOVSL, 8, oreg(r, 4), oreg(sym->st_reg, 8));
+        break;
+      default:
+        emit(I_MOV, 8, oreg(r, 8), oreg(sym->st_reg, 8));
+    }
+    return r;
+  }
+
+  switch (size) {
     case 1:
-      fprintf(Outfile, "\tmovb\t%s, %d(%%rbp)\n", breglist[r],
-              sym->st_posn);
-      break;
     case 4:
-      fprintf(Outfile, "\tmovl\t%s, %d(%%rbp)\n", dreglist[r],
-              sym->st_posn);
-      break;
     case 8:
-      fprintf(Outfile, "\tmovq\t%s, %d(%%rbp)\n", reglist[r],
-              sym->st_posn);
+      emit(I_MOV, size, oreg(r, size), omem(R_RBP, sym->st_posn));
       break;
     default:
       fatald("Bad type in cgstorlocal:", sym->type);
@@ -727,13 +1263,12 @@ void cgcopyarg(int r, int argposn) {
   // should be pushed directly to the stack
   if (argposn > 6) {
     // pushq %r10
-    fprintf(Outfile, "\tpushq\t%s\n", reglist[r]);
+    emit(I_PUSH, 8, oreg(r, 8), NULL);
   } else {
-    // +1 because argposn is 1-based
+    // -1 because argposn is 1-based
     // movq %r10, %rdi
-    fprintf(Outfile, "\tmovq\t%s, %s\n", reglist[r], reglist[FIRSTPARAMREG - argposn + 1]);
+    emit(I_MOV, 8, oreg(r, 8), oreg(paramreg[argposn - 1], 8));
   }
-  cgfreereg(r);
 }
 
 // Given a scalar type, an existing memory offset (which
@@ -755,48 +1290,81 @@ int cgalign(int type, int offset, int direction) {
   return offset;
 }
 
-void cgswitch(int reg, int casecount, int toplabel,
-              int *caselabel, int *caseval, int defaultlabel) {
-  int i, label;
+// Return the condition code which is true when cc is false
+int cgccinvert(int cc) {
+  return ccinvert[cc];
+}
+
+// Add a line of literal text to the instruction list
+static void emittext(char *text) {
+  struct insn *i = emit(I_TEXT, 0, NULL, NULL);
+  i->text = text;
+}
+
+// Compare register r against an immediate value
+void cgcmpimm(int r, int val) {
+  // cmpq $5, %r10
+  emit(I_CMP, 8, oimm(val), oreg(r, 8));
+}
+
+// Jump to the label if the condition code is set
+void cgjcc(int cc, int label) {
+  struct insn *i;
+
+  // je L1
+  i = emit(I_JCC, 0, NULL, olabel(label));
+  i->cc = cc;
+}
+
+// Jump through a table of count labels, indexed by
+// the value in register r less low. Values outside
+// the table go to the default label.
+void cgjumptable(int r, int low, int count, int *labels, int defaultlabel) {
+  struct insn *jmp;
+  char line[TEXTLEN];
+  int i, idx, base, label;
 
   label = genlabel();
-  cglabel(label);
-
-  // If we have no cases, create a single default case.
-  if (casecount == 0) {
-    caseval[0] = 0;
-    caselabel[0] = defaultlabel;
-    casecount = 1;
-  }
-
-  // Set up jump table
-  // L14:                                  # Switch jump table
-  //       .quad   3                       # Three case values
-  //       .quad   1, L10                  # case 1: jump to L10
-  //       .quad   2, L11                  # case 2: jump to L11
-  //       .quad   3, L12                  # case 3: jump to L12
-  //       .quad   L13                     # default: jump to L13
-  fprintf(Outfile, "\t.quad\t%d\n", casecount);
-  for (i = 0; i < casecount; i++)
-    fprintf(Outfile, "\t.quad\t%d, L%d\n", caseval[i], caselabel[i]);
-  fprintf(Outfile, "\t.quad\tL%d\n", defaultlabel);
-
-  cglabel(toplabel);
-  //      movq %r10, %rax           # Load the switch condition in %rax
-  //      leaq L14(%rip), %rdx      # Load the base of jump table in rdx
-  //      jmp switch
-  fprintf(Outfile, "\tmovq\t%s, %%rax\n", reglist[reg]);
-  fprintf(Outfile, "\tleaq\tL%d(%%rip), %%rdx\n", label);
-  fprintf(Outfile, "\tjmp\t__switch\n");
+
+  //      movq    %r10, %r11      # Make the index zero-based
+  //      subq    $3, %r11
+  //      cmpq    $9, %r11        # Go to default when out of range
+  //      ja      L13
+  //      leaq    L14(%rip), %rdx # Jump through the table
+  //      jmp     *(%rdx,%r11,8)
+  idx = alloc_register();
+  emit(I_MOV, 8, oreg(r, 8), oreg(idx, 8));
+  if (low != 0)
+    emit(I_SUB, 8, oimm(low), oreg(idx, 8));
+  cgcmpimm(idx, count - 1);
+  cgjcc(CC_A, defaultlabel);
+  base = alloc_register();
+  emit(I_LEA, 8, cgoperand(OT_LABREF, NOREG, 0, label, NULL), oreg(base, 8));
+  jmp = emit(I_JMP, 0, NULL, omemindex(base, idx, 8));
+  jmp->targets = (int *) arenaalloc(Funcarena, count * sizeof(int));
+  for (i = 0; i < count; i++)
+    jmp->targets[i] = labels[i];
+  jmp->ntargets = count;
+
+  // The table holds absolute addresses, so it goes in a
+  // relocatable read-only section rather than in .text
+  emittext("\t.section\t.data.rel.ro\n\t.p2align\t3\n");
+  snprintf(line, TEXTLEN, "L%d:\n", label);
+  emittext(arenastrdup(Funcarena, line));
+  for (i = 0; i < count; i++) {
+    snprintf(line, TEXTLEN, "\t.quad\tL%d\n", labels[i]);
+    emittext(arenastrdup(Funcarena, line));
+  }
+  emittext("\t.text\n");
 }
 
 void cgmove(int r1, int r2) {
   // movq %r1, %r2
-  fprintf(Outfile, "\tmovq\t%s, %s\n", reglist[r1], reglist[r2]);
+  emit(I_MOV, 8, oreg(r1, 8), oreg(r2, 8));
 }
 
 void cgloadboolean(int r, int val) {
-  fprintf(Outfile, "\tmovq\t$%d, %s\n", val, reglist[r]);
+  emit(I_MOV, 8, oimm(val), oreg(r, 8));
 }
 
 int cgloadvar(struct symtable *sym, int op) {
@@ -813,76 +1381,36 @@ int cgloadvar(struct symtable *sym, int op) {
   if (op == A_PREDEC || op == A_POSTDEC)
     offset = -offset;
 
+  // A variable kept in a register is copied, as our
+  // caller may change the register it gets back
+  if (sym->st_reg != NOREG) {
+    if (op == A_PREINC || op == A_PREDEC)
+      cgstorlocal(cgadd(sym->st_reg, cgloadint(offset, P_LONG)), sym);
+    emit(I_MOV, 8, oreg(sym->st_reg, 8), oreg(r, 8));
+    if (op == A_POSTINC || op == A_POSTDEC)
+      cgstorlocal(cgadd(sym->st_reg, cgloadint(offset, P_LONG)), sym);
+    return r;
+  }
+
   // If we have a pre-op
   if (op == A_PREINC || op == A_PREDEC) {
     // Load the symbol's address
-    if (sym->class == C_LOCAL || sym->class == C_PARAM)
-      fprintf(Outfile, "\tleaq\t%d(%%rbp), %s\n", sym->st_posn, reglist[r]);
-    else
-      fprintf(Outfile, "\tleaq\t%s(%%rip), %s\n", sym->name, reglist[r]);
+    emit(I_LEA, 8, symaddr(sym), oreg(r, 8));
 
     // Modify the value at the address by that much
-    switch (sym->size) {
-      case 1:
-        fprintf(Outfile, "\taddb\t$%d,(%s)\n", offset, reglist[r]);
-        break;
-      case 4:
-        fprintf(Outfile, "\taddl\t$%d,(%s)\n", offset, reglist[r]);
-        break;
-      case 8:
-        fprintf(Outfile, "\taddq\t$%d,(%s)\n", offset, reglist[r]);
-        break;
-    }
+    emit(I_ADD, sym->size, oimm(offset), omem(r, 0));
   }
 
-  if (sym->class == C_LOCAL || sym->class == C_PARAM) {
-    switch (sym->size) {
-      case 1:
-        fprintf(Outfile, "\tmovzbq\t%d(%%rbp), %s\n", sym->st_posn, reglist[r]);
-        break;
-      case 4:
-        fprintf(Outfile, "\tmovslq\t%d(%%rbp), %s\n", sym->st_posn, reglist[r]);
-        break;
-      case 8:
-        fprintf(Outfile, "\tmovq\t%d(%%rbp), %s\n", sym->st_posn, reglist[r]);
-    }
-  } else {
-    switch (sym->size) {
-      case 1:
-        fprintf(Outfile, "\tmovzbq\t%s(%%rip), %s\n", sym->name, reglist[r]);
-        break;
-      case 4:
-        fprintf(Outfile, "\tmovslq\t%s(%%rip), %s\n", sym->name, reglist[r]);
-        break;
-      case 8:
-        fprintf(Outfile, "\tmovq\t%s(%%rip), %s\n", sym->name, reglist[r]);
-    }
-  }
+  loadinto(sym, r);
 
   // If we have a post-operation, get a new register
   if (op == A_POSTINC || op == A_POSTDEC) {
     postreg = alloc_register();
 
     // Load the symbol's address
-    if (sym->class == C_LOCAL || sym->class == C_PARAM)
-      fprintf(Outfile, "\tleaq\t%d(%%rbp), %s\n", sym->st_posn, reglist[postreg]);
-    else
-      fprintf(Outfile, "\tleaq\t%s(%%rip), %s\n", sym->name, reglist[postreg]);
+    emit(I_LEA, 8, symaddr(sym), oreg(postreg, 8));
     // and change the value at that address
-
-    switch (sym->size) {
-      case 1:
-        fprintf(Outfile, "\taddb\t$%d,(%s)\n", offset, reglist[postreg]);
-        break;
-      case 4:
-        fprintf(Outfile, "\taddl\t$%d,(%s)\n", offset, reglist[postreg]);
-        break;
-      case 8:
-        fprintf(Outfile, "\taddq\t$%d,(%s)\n", offset, reglist[postreg]);
-        break;
-    }
-    // and free the register
-    cgfreereg(postreg);
+    emit(I_ADD, sym->size, oimm(offset), omem(postreg, 0));
   }
 
   // Return the register with the value
@@ -1,5 +1,7 @@
-void freeall_registers(int keepreg);
 void cgpreamble();
+// Forget which segment we are in, so that the
+// next output to the assembly file names it
+void cgnoseg(void);
 void cgpostamble();
 void cgfuncpreamble(struct symtable *sym);
 void cgfuncpostamble(struct symtable *sym);
@@ -9,6 +11,10 @@ int cgadd(int r1, int r2);
 int cgsub(int r1, int r2);
 int cgmul(int r1, int r2);
 int cgdivmod(int r1, int r2, int op);
+// Divide register r, holding a value of the given type, by
+// the constant val with shifts and multiplies, for the A_DIVIDE
+// or A_MOD op. Return NOREG if val is one we can't do this for.
+int cgdivconst(int r, int val, int op, int type);
 // Load a value to a global symbol
 int cgstorglob(int r, struct symtable *sym);
 
@@ -23,11 +29,19 @@ int cgcompare_and_set(int ASTop, int r1, int r2, int type);
 // Compares values in two registers and jumps to the label
 // if the comparison is false
 int cgcompare_and_jump(int ASTop, int r1, int r2, int label, int type);
+// Compares values in two registers and returns a new
+// register holding rtrue if the comparison is true,
+// otherwise rfalse
+int cgcompare_and_select(int ASTop, int r1, int r2, int rtrue, int rfalse,
+                         int type);
 
 // Generates a jump to a given label
 void cgjump(int l);
 // Generates a label, e.g. L1
 void cglabel(int l);
+// Generates a label at the top of a loop,
+// aligned so that the loop fetches quickly
+void cglooplabel(int l);
 
 // Widen the value in the register from the old
 // to the new type, and return a register with the
@@ -40,6 +54,10 @@ int cgprimsize(int type);
 // given register and return a register with the
 // result of the function call
 int cgcall(struct symtable *sym, int numargs);
+// Leave the current function by jumping to another, whose
+// arguments are already in their registers. The callee
+// returns straight to our caller.
+void cgtailcall(struct symtable *sym, int numargs);
 // Return from a function call while returning a
 // value in the passed register
 void cgreturn(int reg, struct symtable *sym);
@@ -53,6 +71,9 @@ int cgderef(int r, int type);
 // Shift bits to the left by a constant and return the
 // register containing the result
 int cgshlconst(int r, int val);
+// Put the address disp(base,index,scale) in a new register.
+// index can be NOREG.
+int cglea(int base, int index, int scale, int disp);
 // Store a value through a dereferenced pointer
 int cgstorderef(int r1, int r2, int type);
 // Generate code for a string literal to a given label
@@ -68,7 +89,7 @@ int cgxor(int r1, int r2);
 int cgnegate(int r);
 int cginvert(int r);
 int cgshl(int r1, int r2);
-int cgshr(int r1, int r2);
+int cgshr(int r1, int r2, int type);
 int cglognot(int r);
 int cgboolean(int r, int op, int label);
 // Reset offset of local variables when parsing a new function
@@ -78,8 +99,14 @@ int cgloadvar(struct symtable *sym, int op);
 int cgstorlocal(int r, struct symtable *sym);
 void cgcopyarg(int r, int argposn);
 int cgalign(int type, int offset, int direction);
-void cgswitch(int reg, int casecount, int toplabel,
-              int *caselabel, int *caseval, int defaultlabel);
+// Compare a register against an immediate value
+void cgcmpimm(int r, int val);
+// Jump to the label if the CC_ condition code is set
+void cgjcc(int cc, int label);
+// Return the condition code which is true when cc is false
+int cgccinvert(int cc);
+// Jump through a table of count labels indexed by r - low
+void cgjumptable(int r, int low, int count, int *labels, int defaultlabel);
 int alloc_register(void);
 void cgmove(int r1, int r2);
 // Logically OR two registers and return a
@@ -89,5 +116,9 @@ int cglogor(int r1, int r2);
 // the result, 1 or 0
 int cglogand(int r1, int r2);
 void cgloadboolean(int r, int val);
-void spill_all_regs(void);
-void cgfreereg(int reg);
\ No newline at end of file
+// Build an instruction operand
+struct operand *cgoperand(int kind, int reg, int size, int val, char *name);
+// Build an instruction that is not yet on any list
+struct insn *cginsn(int op, int size, struct operand *src, struct operand *dst);
+// Allocate a slot in the current function's stack frame
+int cgspillslot(void);
\ No newline at end of file
@@ -0,0 +1,1295 @@
+// Preprocessor
+//
+// Each source file is read in whole and preprocessed a logical
+// line at a time: backslash-newlines are joined, comments are
+// replaced with a space, #-directives are obeyed and macros are
+// expanded in everything else. The scanner gets the expanded
+// lines one at a time from ppline(), which also sets Line and
+// Infilename to where each line came from.
+//
+// Headers are kept in memory once they have been read, so a
+// header included by several files in the same run is only read
+// once. If a header is wrapped in the usual #ifndef guard, we
+// note the guard macro and don't even look at the header again
+// while that macro is defined.
+
+#include "data.h"
+#include "misc.h"
+#include "cpp.h"
+
+#define NMACROHASH 512    // Buckets in the macro hash index
+#define MAXCOND 64        // Depth of nested #if's
+#define MAXINCLUDE 64     // Depth of nested #include's
+#define MAXEXPAND 256     // Depth of nested macro expansions
+#define READSIZE 65536    // Size of the reads when loading a file
+
+// States of an #if on the conditional stack
+enum {
+  IF_TAKING,              // We are in the branch being taken
+  IF_SEEKING,             // No branch taken yet, look for one
+  IF_DONE,                // A branch was taken, skip the rest
+  IF_SKIPPING             // The whole #if is inside a skipped branch
+};
+
+// Include guard detection states
+enum {
+  GUARD_START,            // Nothing seen yet in the file
+  GUARD_INSIDE,           // Inside a possible guard's #ifndef
+  GUARD_CLOSED,           // Seen the guard's #endif
+  GUARD_NONE              // The file doesn't have a guard
+};
+
+static struct macro **Machash;      // Hash index of the defined macros
+static struct srcfile *Curfile;     // File being read, top of the include stack
+static int Includedepth;            // Number of files on the include stack
+static struct hdrcache *Hdrcache;   // Headers read in during this run
+static int Condstate[MAXCOND];      // Stack of IF_ states
+static int Condelse[MAXCOND];       // Whether each #if has seen its #else
+static int Condlevel;               // Depth of the conditional stack
+static struct strbuf *Rawline;      // Logical line as read in
+static struct strbuf *Joinline;     // Logical lines joined for a macro call
+static struct strbuf *Outline;      // Logical line after macro expansion
+
+// Growable strings
+
+static struct strbuf *newsb(void) {
+  struct strbuf *b = (struct strbuf *) malloc(sizeof(struct strbuf));
+
+  if (b == NULL)
+    fatal("Unable to malloc a string buffer in newsb");
+  b->size = 256;
+  b->s = (char *) malloc(b->size);
+  if (b->s == NULL)
+    fatal("Unable to malloc a string buffer in newsb");
+  b->len = 0;
+  b->s[0] = 0;
+  return b;
+}
+
+static void sbreset(struct strbuf *b) {
+  b->len = 0;
+  b->s[0] = 0;
+}
+
+// Make sure that the buffer has room for n more characters
+static void sbgrow(struct strbuf *b, int n) {
+  if (b->len + n + 1 <= b->size)
+    return;
+  while (b->len + n + 1 > b->size)
+    b->size = b->size * 2;
+  b->s = (char *) realloc(b->s, b->size);
+  if (b->s == NULL)
+    fatal("Unable to grow a string buffer in sbgrow");
+}
+
+static void sbputc(struct strbuf *b, int c) {
+  sbgrow(b, 1);
+  b->s[b->len] = (char) c;
+  b->len = b->len + 1;
+  b->s[b->len] = 0;
+}
+
+// Append the first n characters of s
+static void sbputn(struct strbuf *b, char *s, int n) {
+  int i;
+
+  sbgrow(b, n);
+  for (i = 0; i < n; i++)
+    b->s[b->len + i] = s[i];
+  b->len = b->len + n;
+  b->s[b->len] = 0;
+}
+
+static void sbputs(struct strbuf *b, char *s) {
+  sbputn(b, s, (int) strlen(s));
+}
+
+// Replace the n characters at posn with the string s
+static void sbreplace(struct strbuf *b, int posn, int n, char *s) {
+  int i, slen = (int) strlen(s);
+  int delta = slen - n;
+
+  sbgrow(b, delta > 0 ? delta : 0);
+  if (delta > 0) {
+    for (i = b->len; i >= posn + n; i--)
+      b->s[i + delta] = b->s[i];
+  } else if (delta < 0) {
+    for (i = posn + n; i <= b->len; i++)
+      b->s[i + delta] = b->s[i];
+  }
+  for (i = 0; i < slen; i++)
+    b->s[posn + i] = s[i];
+  b->len = b->len + delta;
+}
+
+// Return a copy of the n characters at s
+static char *strndup_(char *s, int n) {
+  char *p = (char *) malloc(n + 1);
+  int i;
+
+  if (p == NULL)
+    fatal("Unable to malloc a string in strndup_");
+  for (i = 0; i < n; i++)
+    p[i] = s[i];
+  p[n] = 0;
+  return p;
+}
+
+static int isidstart(int c) {
+  return (isalpha(c) || c == '_');
+}
+
+static int isidchar(int c) {
+  return (isalnum(c) || c == '_');
+}
+
+static int isblankch(int c) {
+  return (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v');
+}
+
+// Return the position after any blanks at posn in s
+static int skipblanks(char *s, int posn) {
+  while (isblankch(s[posn]))
+    posn++;
+  return posn;
+}
+
+// Return the position just after the string or character
+// literal which starts at posn in s
+static int skipliteral(char *s, int posn) {
+  int q = s[posn];
+
+  posn++;
+  while (s[posn] != 0 && s[posn] != q) {
+    if (s[posn] == '\\' && s[posn + 1] != 0)
+      posn++;
+    posn++;
+  }
+  if (s[posn] == q)
+    posn++;
+  return posn;
+}
+
+// Return the position just after the identifier at posn in s
+static int skipident(char *s, int posn) {
+  while (isidchar(s[posn]))
+    posn++;
+  return posn;
+}
+
+// Macros
+
+static int machash(char *s, int len) {
+  int i, h = 0;
+
+  for (i = 0; i < len; i++)
+    h = ((h << 5) + h + s[i]) & 0xffffff;
+  return h & (NMACROHASH - 1);
+}
+
+// Find the macro whose name is the len characters at s
+static struct macro *findmacro(char *s, int len) {
+  struct macro *m;
+
+  for (m = Machash[machash(s, len)]; m != NULL; m = m->next)
+    if (!strncmp(m->name, s, len) && m->name[len] == 0)
+      return m;
+  return NULL;
+}
+
+// Return true if the len characters at s are __LINE__ or
+// __FILE__. These aren't kept as macros as their values change
+// from line to line and from file to file
+static int isbuiltin(char *s, int len) {
+  if (len != 8)
+    return (0);
+  if (!strncmp(s, "__LINE__", 8) || !strncmp(s, "__FILE__", 8))
+    return (1);
+  return (0);
+}
+
+static void undefmacro(char *s, int len) {
+  struct macro *m, *prev = NULL;
+  int h = machash(s, len);
+
+  for (m = Machash[h]; m != NULL; m = m->next) {
+    if (!strncmp(m->name, s, len) && m->name[len] == 0) {
+      if (prev == NULL)
+        Machash[h] = m->next;
+      else
+        prev->next = m->next;
+      return;
+    }
+    prev = m;
+  }
+}
+
+// Add a macro, replacing any existing one of the same name
+static struct macro *addmacro(char *name, int nparams, char **params, char *body) {
+  struct macro *m = (struct macro *) malloc(sizeof(struct macro));
+  int len = (int) strlen(name);
+  int h = machash(name, len);
+
+  if (m == NULL)
+    fatal("Unable to malloc a macro in addmacro");
+
+  undefmacro(name, len);
+  m->name = name;
+  m->nparams = nparams;
+  m->params = params;
+  m->body = body;
+  m->variadic = 0;
+  m->disabled = 0;
+  m->next = Machash[h];
+  Machash[h] = m;
+  return m;
+}
+
+// Macro expansion
+
+static void expand(char *s, struct strbuf *out);
+
+// Return the index of the parameter named by the
+// len characters at s, or -1 if there isn't one
+static int paramindex(struct macro *m, char *s, int len) {
+  char *p;
+  int i;
+
+  for (i = 0; i < m->nparams; i++) {
+    p = m->params[i];
+    if (!strncmp(p, s, len) && p[len] == 0)
+      return i;
+  }
+  return -1;
+}
+
+// Append an argument to out as a string literal
+static void stringify(struct strbuf *out, char *arg) {
+  int i = 0, start;
+
+  sbputc(out, '"');
+  while (arg[i] != 0) {
+    if (arg[i] == '"' || arg[i] == '\'') {
+      // Literals are copied with their quotes and backslashes escaped
+      start = i;
+      i = skipliteral(arg, i);
+      for (; start < i; start++) {
+        if (arg[start] == '"' || arg[start] == '\\')
+          sbputc(out, '\\');
+        sbputc(out, arg[start]);
+      }
+    } else if (isblankch(arg[i])) {
+      // Each run of blanks between tokens becomes one space
+      i = skipblanks(arg, i);
+      sbputc(out, ' ');
+    } else {
+      sbputc(out, arg[i]);
+      i++;
+    }
+  }
+  sbputc(out, '"');
+}
+
+// Trim any blanks from the end of the buffer
+static void trimblanks(struct strbuf *b) {
+  while (b->len > 0 && isblankch(b->s[b->len - 1]))
+    b->len = b->len - 1;
+  b->s[b->len] = 0;
+}
+
+// Return the body of macro m with its parameters
+// replaced by the arguments
+static char *substitute(struct macro *m, char **args) {
+  struct strbuf *out = newsb();
+  char *body = m->body;
+  int i = 0, j, k, n, pasting = 0;
+  char *result;
+
+  while (body[i] != 0) {
+    // Token pasting: drop the ## and the blanks around it
+    if (body[i] == '#' && body[i + 1] == '#') {
+      trimblanks(out);
+      i = skipblanks(body, i + 2);
+      pasting = 1;
+    }
+
+    // Stringify a parameter
+    else if (body[i] == '#') {
+      j = skipblanks(body, i + 1);
+      k = -1;
+      if (isidstart(body[j]))
+        k = paramindex(m, body + j, skipident(body, j) - j);
+      if (k >= 0) {
+        stringify(out, args[k]);
+        i = skipident(body, j);
+      } else {
+        sbputc(out, '#');
+        i++;
+      }
+      pasting = 0;
+    }
+
+    // An identifier, which may be a parameter. Parameters
+    // next to a ## are not expanded, the rest are
+    else if (isidstart(body[i])) {
+      j = skipident(body, i);
+      k = paramindex(m, body + i, j - i);
+      if (k < 0)
+        sbputn(out, body + i, j - i);
+      else {
+        n = skipblanks(body, j);
+        if (pasting || (body[n] == '#' && body[n + 1] == '#'))
+          sbputs(out, args[k]);
+        else
+          expand(args[k], out);
+      }
+      i = j;
+      pasting = 0;
+    }
+
+    else if (body[i] == '"' || body[i] == '\'') {
+      j = skipliteral(body, i);
+      sbputn(out, body + i, j - i);
+      i = j;
+      pasting = 0;
+    }
+
+    else {
+      sbputc(out, body[i]);
+      i++;
+      pasting = 0;
+    }
+  }
+
+  result = out->s;
+  free(out);
+  return result;
+}
+
+// Collect the arguments of a call to macro m, starting at
+// the '(' at posn in s. Put the position after the ')' in
+// *endposn and return the array of arguments.
+static char **collectargs(struct macro *m, char *s, int posn, int *endposn) {
+  char **args;
+  int nargs = 0, depth = 0, start, end, maxargs;
+
+  maxargs = m->nparams > 0 ? m->nparams : 1;
+  args = (char **) malloc(maxargs * sizeof(char *));
+  if (args == NULL)
+    fatal("Unable to malloc macro arguments in collectargs");
+
+  posn++;
+  start = posn;
+  while (1) {
+    if (s[posn] == 0)
+      fatals("Unterminated argument list for macro", m->name);
+
+    if (s[posn] == '"' || s[posn] == '\'')
+      posn = skipliteral(s, posn);
+    else if (s[posn] == '(') {
+      depth++;
+      posn++;
+    } else if (depth > 0 && s[posn] == ')') {
+      depth--;
+      posn++;
+    } else if (depth == 0 && (s[posn] == ')' || s[posn] == ',')) {
+      // The variadic parameter takes all the remaining arguments
+      if (s[posn] == ',' && m->variadic && nargs == m->nparams - 1)
+        posn++;
+      else {
+        if (nargs == maxargs)
+          fatals("Wrong number of arguments to macro", m->name);
+        start = skipblanks(s, start);
+        end = posn;
+        while (end > start && isblankch(s[end - 1]))
+          end--;
+        args[nargs] = strndup_(s + start, end - start);
+        nargs++;
+
+        if (s[posn] == ')')
+          break;
+        posn++;
+        start = posn;
+      }
+    } else
+      posn++;
+  }
+
+  // A macro with no parameters is called with one empty argument
+  if (m->nparams == 0 && args[0][0] == 0)
+    nargs = 0;
+  // And a variadic one may be called with no variable arguments
+  if (m->variadic && nargs == m->nparams - 1) {
+    args[nargs] = "";
+    nargs++;
+  }
+  if (nargs != m->nparams)
+    fatals("Wrong number of arguments to macro", m->name);
+
+  *endposn = posn + 1;
+  return args;
+}
+
+// Expand the macros in the string s and append the result to
+// out. The replacement for each macro is put back into the
+// text and rescanned. A macro is disabled while we are within
+// its own replacement, so that it can't expand forever.
+static void expand(char *s, struct strbuf *out) {
+  struct strbuf *w = newsb();
+  struct macro *actmac[MAXEXPAND];
+  int actend[MAXEXPAND];
+  int nact = 0, posn = 0, start, end, len, delta, k, n;
+  struct macro *m;
+  char buf[TEXTLEN];
+  char **args;
+  char *repl;
+
+  sbputs(w, s);
+
+  while (w->s[posn] != 0) {
+    // Re-enable the macros whose replacements we have passed
+    n = 0;
+    for (k = 0; k < nact; k++) {
+      m = actmac[k];
+      if (actend[k] <= posn)
+        m->disabled = m->disabled - 1;
+      else {
+        actmac[n] = actmac[k];
+        actend[n] = actend[k];
+        n++;
+      }
+    }
+    nact = n;
+
+    if (isidstart(w->s[posn])) {
+      start = posn;
+      posn = skipident(w->s, posn);
+      m = findmacro(w->s + start, posn - start);
+
+      // Put in the line and file that ppline() is giving out.
+      // A macro call over several lines gets its first line
+      if (m == NULL && isbuiltin(w->s + start, posn - start)) {
+        if (w->s[start + 2] == 'L')
+          snprintf(buf, TEXTLEN, "%d", Line);
+        else
+          snprintf(buf, TEXTLEN, "%c%s%c", '"', Infilename, '"');
+        len = (int) strlen(buf);
+        delta = len - (posn - start);
+        sbreplace(w, start, posn - start, buf);
+        for (k = 0; k < nact; k++)
+          actend[k] = actend[k] + delta;
+        posn = start + len;
+      }
+
+      repl = NULL;
+      if (m != NULL && m->disabled == 0) {
+        if (m->nparams < 0) {
+          repl = m->body;
+          end = posn;
+        } else {
+          // A function-like macro without arguments is left alone
+          k = skipblanks(w->s, posn);
+          if (w->s[k] == '(') {
+            args = collectargs(m, w->s, k, &end);
+            repl = substitute(m, args);
+          }
+        }
+      }
+
+      if (repl != NULL) {
+        if (nact == MAXEXPAND)
+          fatals("Macro expansion too deep in", m->name);
+
+        // Replace the call and rescan from its start
+        len = (int) strlen(repl);
+        delta = len - (end - start);
+        sbreplace(w, start, end - start, repl);
+        for (k = 0; k < nact; k++)
+          actend[k] = actend[k] + delta;
+        m->disabled = m->disabled + 1;
+        actmac[nact] = m;
+        actend[nact] = start + len;
+        nact++;
+        posn = start;
+      }
+    }
+
+    else if (isdigit(w->s[posn])) {
+      // Skip a number so that a suffix isn't taken as a macro
+      while (isidchar(w->s[posn]) || w->s[posn] == '.')
+        posn++;
+    }
+
+    else if (w->s[posn] == '"' || w->s[posn] == '\'')
+      posn = skipliteral(w->s, posn);
+
+    else
+      posn++;
+  }
+
+  for (k = 0; k < nact; k++) {
+    m = actmac[k];
+    m->disabled = m->disabled - 1;
+  }
+
+  sbputs(out, w->s);
+  free(w->s);
+  free(w);
+}
+
+// #if expressions. The expression is in Exprs and we
+// are looking at the character at Exprposn.
+
+static char *Exprs;
+static int Exprposn;
+
+// Binary operators and their precedence
+static char *Binops[] = {
+  "||", "&&", "|", "^", "&", "==", "!=", "<", "<=", ">", ">=",
+  "<<", ">>", "+", "-", "*", "/", "%"
+};
+static int Binprec[] = {
+  1, 2, 3, 4, 5, 6, 6, 7, 7, 7, 7,
+  8, 8, 9, 9, 10, 10, 10
+};
+#define NUMBINOPS 18
+
+static long ternaryexpr(void);
+
+// Return the next non-blank character without using it
+static int peekch(void) {
+  Exprposn = skipblanks(Exprs, Exprposn);
+  return Exprs[Exprposn];
+}
+
+// Return the index of the longest binary operator
+// which is next in the expression, or -1 if none
+static int findbinop(void) {
+  int i, len, best = -1, bestlen = 0;
+
+  peekch();
+  for (i = 0; i < NUMBINOPS; i++) {
+    len = (int) strlen(Binops[i]);
+    if (len > bestlen && !strncmp(Exprs + Exprposn, Binops[i], len)) {
+      best = i;
+      bestlen = len;
+    }
+  }
+  return best;
+}
+
+// Number or character literal, parenthesised
+// expression or unary operator
+static long unaryexpr(void) {
+  long val = 0;
+  int c, radix = 10, k;
+
+  c = peekch();
+  if (c == '!' || c == '~' || c == '-' || c == '+') {
+    Exprposn++;
+    val = unaryexpr();
+    if (c == '!')
+      return !val;
+    if (c == '~')
+      return ~val;
+    if (c == '-')
+      return -val;
+    return val;
+  }
+
+  if (c == '(') {
+    Exprposn++;
+    val = ternaryexpr();
+    if (peekch() != ')')
+      fatal("')' expected in #if expression");
+    Exprposn++;
+    return val;
+  }
+
+  if (c == '\'') {
+    Exprposn++;
+    c = Exprs[Exprposn];
+    if (c == '\\') {
+      Exprposn++;
+      c = Exprs[Exprposn];
+      if (c == 'n')
+        c = '\n';
+      else if (c == 't')
+        c = '\t';
+      else if (c == '0')
+        c = 0;
+    }
+    Exprposn = skipliteral(Exprs, Exprposn - 1);
+    return c;
+  }
+
+  if (isdigit(c)) {
+    if (c == '0') {
+      radix = 8;
+      Exprposn++;
+      if (Exprs[Exprposn] == 'x' || Exprs[Exprposn] == 'X') {
+        radix = 16;
+        Exprposn++;
+      }
+    }
+    while (isxdigit(Exprs[Exprposn])) {
+      c = tolower(Exprs[Exprposn]);
+      k = (c <= '9') ? c - '0' : c - 'a' + 10;
+      if (k >= radix)
+        break;
+      val = val * radix + k;
+      Exprposn++;
+    }
+    // Skip any suffix
+    while (isidchar(Exprs[Exprposn]))
+      Exprposn++;
+    return val;
+  }
+
+  // Identifiers left after macro expansion are zero
+  if (isidstart(c)) {
+    Exprposn = skipident(Exprs, Exprposn);
+    return 0;
+  }
+
+  fatalc("Unexpected character in #if expression", c);
+  return 0;
+}
+
+// Binary operators with at least the given precedence
+static long binaryexpr(int minprec) {
+  long left, right;
+  int op;
+
+  left = unaryexpr();
+  while (1) {
+    op = findbinop();
+    if (op < 0 || Binprec[op] < minprec)
+      return left;
+    Exprposn = Exprposn + (int) strlen(Binops[op]);
+    right = binaryexpr(Binprec[op] + 1);
+
+    switch (op) {
+      case 0:  left = left || right; break;
+      case 1:  left = left && right; break;
+      case 2:  left = left | right; break;
+      case 3:  left = left ^ right; break;
+      case 4:  left = left & right; break;
+      case 5:  left = left == right; break;
+      case 6:  left = left != right; break;
+      case 7:  left = left < right; break;
+      case 8:  left = left <= right; break;
+      case 9:  left = left > right; break;
+      case 10: left = left >= right; break;
+      case 11: left = left << right; break;
+      case 12: left = left >> right; break;
+      case 13: left = left + right; break;
+      case 14: left = left - right; break;
+      case 15: left = left * right; break;
+      // Both sides are always evaluated, so a division by
+      // zero in a branch that doesn't matter gives zero
+      case 16: left = (right == 0) ? 0 : left / right; break;
+      case 17: left = (right == 0) ? 0 : left % right; break;
+    }
+  }
+  return left;
+}
+
+static long ternaryexpr(void) {
+  long cond, a, b;
+
+  cond = binaryexpr(1);
+  if (peekch() != '?')
+    return cond;
+  Exprposn++;
+  a = ternaryexpr();
+  if (peekch() != ':')
+    fatal("':' expected in #if expression");
+  Exprposn++;
+  b = ternaryexpr();
+  if (cond == 0)
+    return b;
+  return a;
+}
+
+// Evaluate the expression of an #if or #elif
+static int evalif(char *s) {
+  struct strbuf *d = newsb();
+  struct strbuf *e = newsb();
+  int posn = 0, start, end, paren;
+  long val;
+
+  // Replace each "defined X" or "defined(X)" with 1 or 0
+  while (s[posn] != 0) {
+    if (isidstart(s[posn])) {
+      start = posn;
+      posn = skipident(s, posn);
+      if (posn - start == 7 && !strncmp(s + start, "defined", 7)) {
+        posn = skipblanks(s, posn);
+        paren = 0;
+        if (s[posn] == '(') {
+          paren = 1;
+          posn = skipblanks(s, posn + 1);
+        }
+        if (!isidstart(s[posn]))
+          fatal("Identifier expected after defined");
+        start = posn;
+        end = skipident(s, posn);
+        if (findmacro(s + start, end - start) != NULL ||
+            isbuiltin(s + start, end - start))
+          sbputs(d, " 1 ");
+        else
+          sbputs(d, " 0 ");
+        posn = skipblanks(s, end);
+        if (paren) {
+          if (s[posn] != ')')
+            fatal("')' expected after defined");
+          posn++;
+        }
+      } else
+        sbputn(d, s + start, posn - start);
+    } else if (s[posn] == '"' || s[posn] == '\'') {
+      start = posn;
+      posn = skipliteral(s, posn);
+      sbputn(d, s + start, posn - start);
+    } else {
+      sbputc(d, s[posn]);
+      posn++;
+    }
+  }
+
+  expand(d->s, e);
+  Exprs = e->s;
+  Exprposn = 0;
+  val = ternaryexpr();
+  if (peekch() != 0)
+    fatals("Unexpected text in #if expression", Exprs + Exprposn);
+
+  free(d->s);
+  free(d);
+  free(e->s);
+  free(e);
+  if (val == 0)
+    return 0;
+  return 1;
+}
+
+// Source files
+
+// Read a whole file into memory and return its contents,
+// or NULL if it can't be opened
+static char *readfile(char *name) {
+  FILE *f;
+  char *text;
+  int size = READSIZE, len = 0, n;
+
+  if ((f = fopen(name, "r")) == NULL)
+    return NULL;
+
+  text = (char *) malloc(size + 1);
+  if (text == NULL)
+    fatal("Unable to malloc file contents in readfile");
+
+  while (1) {
+    n = (int) fread(text + len, 1, size - len, f);
+    if (n <= 0)
+      break;
+    len = len + n;
+    if (len == size) {
+      size = size * 2;
+      text = (char *) realloc(text, size + 1);
+      if (text == NULL)
+        fatal("Unable to grow file contents in readfile");
+    }
+  }
+
+  fclose(f);
+  text[len] = 0;
+  return text;
+}
+
+// Start reading a file, saving the one we were reading
+static void pushfile(char *name, char *text, struct hdrcache *hdr) {
+  struct srcfile *f;
+
+  if (Includedepth == MAXINCLUDE)
+    fatals("Includes nested too deeply at", name);
+
+  f = (struct srcfile *) malloc(sizeof(struct srcfile));
+  if (f == NULL)
+    fatal("Unable to malloc a source file in pushfile");
+
+  f->name = name;
+  f->text = text;
+  f->posn = 0;
+  f->line = 1;
+  f->startline = 1;
+  f->condbase = Condlevel;
+  f->guard = NULL;
+  f->guardstate = GUARD_START;
+  f->hdr = hdr;
+  f->prev = Curfile;
+  Curfile = f;
+  Includedepth++;
+}
+
+// Finish reading the current file and go
+// back to the one which included it
+static void popfile(void) {
+  struct srcfile *f = Curfile;
+
+  if (Condlevel != f->condbase) {
+    Line = f->line;
+    fatal("Unterminated #if at end of file");
+  }
+
+  // Note the guard of a header wrapped in one
+  if (f->hdr != NULL && f->guardstate == GUARD_CLOSED)
+    f->hdr->guard = f->guard;
+
+  // Headers stay in the cache, but not the main file
+  if (f->hdr == NULL)
+    free(f->text);
+  Curfile = f->prev;
+  Includedepth--;
+  free(f);
+}
+
+// Find the header called name and return it, reading it in if
+// we haven't already. A "quoted" header is looked for next to
+// the file including it before the include directory.
+static struct hdrcache *findheader(char *name, int quoted) {
+  char dir[TEXTLEN], path[TEXTLEN];
+  struct hdrcache *h;
+  char *text;
+  int i, try;
+
+  // Work out the directory of the current file
+  snprintf(dir, TEXTLEN, "%s", Curfile->name);
+  for (i = (int) strlen(dir); i > 0 && dir[i - 1] != '/'; i--)
+    dir[i - 1] = 0;
+
+  for (try = (quoted != 0) ? 0 : 1; try < 2; try++) {
+    if (try == 0)
+      snprintf(path, TEXTLEN, "%s%s", dir, name);
+    else
+      snprintf(path, TEXTLEN, "%s/%s", INCDIR, name);
+
+    for (h = Hdrcache; h != NULL; h = h->next)
+      if (!strcmp(h->path, path))
+        return h;
+
+    text = readfile(path);
+    if (text != NULL) {
+      h = (struct hdrcache *) malloc(sizeof(struct hdrcache));
+      if (h == NULL)
+        fatal("Unable to malloc a header in findheader");
+      h->path = strdup(path);
+      h->text = text;
+      h->guard = NULL;
+      h->next = Hdrcache;
+      Hdrcache = h;
+      return h;
+    }
+  }
+
+  return NULL;
+}
+
+// Read the next logical line of the current file into
+// Rawline, joining lines that end in a backslash and
+// replacing comments with a space. Return 0 at the
+// end of the file.
+static int readline(void) {
+  struct srcfile *f = Curfile;
+  char *t = f->text;
+  int p = f->posn, q;
+
+  sbreset(Rawline);
+  if (t[p] == 0)
+    return 0;
+  f->startline = f->line;
+
+  while (t[p] != 0 && t[p] != '\n') {
+    if (t[p] == '\\' && t[p + 1] == '\n') {
+      p = p + 2;
+      f->line = f->line + 1;
+    } else if (t[p] == '/' && t[p + 1] == '/') {
+      while (t[p] != 0 && t[p] != '\n')
+        p++;
+    } else if (t[p] == '/' && t[p + 1] == '*') {
+      p = p + 2;
+      while (t[p] != 0 && !(t[p] == '*' && t[p + 1] == '/')) {
+        if (t[p] == '\n')
+          f->line = f->line + 1;
+        p++;
+      }
+      if (t[p] == 0) {
+        Line = f->startline;
+        fatal("Unterminated comment");
+      }
+      p = p + 2;
+      sbputc(Rawline, ' ');
+    } else if (t[p] == '"' || t[p] == '\'') {
+      // Copy literals as they are, so that
+      // comment markers in them are left alone
+      q = skipliteral(t, p);
+      sbputn(Rawline, t + p, q - p);
+      p = q;
+    } else {
+      sbputc(Rawline, t[p]);
+      p++;
+    }
+  }
+
+  if (t[p] == '\n') {
+    p++;
+    f->line = f->line + 1;
+  }
+  f->posn = p;
+  return 1;
+}
+
+// Return true if the next thing in the current file,
+// after any white space, is a '('
+static int parennext(void) {
+  struct srcfile *f = Curfile;
+  char *t = f->text;
+  int p = f->posn;
+
+  while (isblankch(t[p]) || t[p] == '\n')
+    p++;
+  return (t[p] == '(');
+}
+
+// Return true if the logical line has a function-like macro
+// call which isn't finished: either the '(' after its name
+// is unclosed, or the line ends with the name and the '('
+// is on a following line. A call can be at any paren depth,
+// e.g. as an argument to a function
+static int opencall(char *s) {
+  int posn = 0, start, depth = 0, calldepth = -1, waiting = 0;
+  struct macro *m;
+
+  while (s[posn] != 0) {
+    if (isidstart(s[posn])) {
+      start = posn;
+      posn = skipident(s, posn);
+      m = findmacro(s + start, posn - start);
+      waiting = 0;
+      if (m != NULL && m->nparams >= 0 && calldepth < 0)
+        waiting = 1;
+    } else if (s[posn] == '"' || s[posn] == '\'') {
+      posn = skipliteral(s, posn);
+      waiting = 0;
+    } else {
+      if (s[posn] == '(') {
+        // Note the depth outside the call's parentheses
+        if (waiting)
+          calldepth = depth;
+        depth++;
+      }
+      if (s[posn] == ')' && depth > 0) {
+        depth--;
+        if (depth == calldepth)
+          calldepth = -1;
+      }
+      if (!isblankch(s[posn]))
+        waiting = 0;
+      posn++;
+    }
+  }
+  if (calldepth >= 0)
+    return (1);
+  if (waiting)
+    return (parennext());
+  return (0);
+}
+
+// Return true if lines are being used, not skipped
+static int active(void) {
+  return (Condlevel == 0 || Condstate[Condlevel - 1] == IF_TAKING);
+}
+
+static void pushcond(int state) {
+  if (Condlevel == MAXCOND)
+    fatal("#if nested too deeply");
+  if (!active())
+    state = IF_SKIPPING;
+  Condstate[Condlevel] = state;
+  Condelse[Condlevel] = 0;
+  Condlevel++;
+}
+
+// Do a #define. posn is just after the word define
+static void dodefine(char *s, int posn) {
+  char **params = NULL;
+  char *name;
+  int start, nparams = -1, variadic = 0, end;
+  struct macro *m;
+
+  posn = skipblanks(s, posn);
+  if (!isidstart(s[posn]))
+    fatal("Macro name expected in #define");
+  start = posn;
+  posn = skipident(s, posn);
+  name = strndup_(s + start, posn - start);
+
+  // A '(' straight after the name starts the parameters
+  if (s[posn] == '(') {
+    nparams = 0;
+    params = (char **) malloc(TEXTLEN * sizeof(char *));
+    if (params == NULL)
+      fatal("Unable to malloc macro parameters in dodefine");
+    posn = skipblanks(s, posn + 1);
+    if (s[posn] != ')') {
+      while (1) {
+        posn = skipblanks(s, posn);
+        if (!strncmp(s + posn, "...", 3)) {
+          params[nparams] = "__VA_ARGS__";
+          variadic = 1;
+          posn = posn + 3;
+        } else {
+          if (!isidstart(s[posn]))
+            fatals("Parameter name expected in #define", name);
+          start = posn;
+          posn = skipident(s, posn);
+          params[nparams] = strndup_(s + start, posn - start);
+        }
+        nparams++;
+        posn = skipblanks(s, posn);
+        if (s[posn] == ')')
+          break;
+        if (s[posn] != ',' || variadic || nparams == TEXTLEN)
+          fatals("Bad parameter list in #define", name);
+        posn++;
+      }
+    }
+    posn++;
+  }
+
+  // The body is the rest of the line, without blanks at either end
+  posn = skipblanks(s, posn);
+  end = (int) strlen(s);
+  while (end > posn && isblankch(s[end - 1]))
+    end--;
+
+  m = addmacro(name, nparams, params, strndup_(s + posn, end - posn));
+  m->variadic = variadic;
+}
+
+// Do an #include. posn is just after the word include
+static void doinclude(char *s, int posn) {
+  struct strbuf *e = NULL;
+  struct hdrcache *h;
+  char *name;
+  int start, quoted, end, close;
+
+  // Allow the name to come from a macro
+  posn = skipblanks(s, posn);
+  if (s[posn] != '"' && s[posn] != '<') {
+    e = newsb();
+    expand(s + posn, e);
+    s = e->s;
+    posn = skipblanks(s, 0);
+  }
+
+  if (s[posn] != '"' && s[posn] != '<')
+    fatal("Expecting a file name after #include");
+  quoted = 0;
+  close = '>';
+  if (s[posn] == '"') {
+    quoted = 1;
+    close = '"';
+  }
+  start = posn + 1;
+  end = start;
+  while (s[end] != 0 && s[end] != close)
+    end++;
+  if (s[end] == 0)
+    fatal("Unterminated file name in #include");
+  name = strndup_(s + start, end - start);
+
+  h = findheader(name, quoted);
+  if (h == NULL)
+    fatals("Unable to find header", name);
+
+  // Skip a header whose include guard is already defined
+  if (h->guard == NULL || findmacro(h->guard, (int) strlen(h->guard)) == NULL)
+    pushfile(h->path, h->text, h);
+
+  free(name);
+  if (e != NULL) {
+    free(e->s);
+    free(e);
+  }
+}
+
+// Obey the directive in the logical line s. posn is just after the '#'
+static void directive(char *s, int posn) {
+  struct srcfile *f = Curfile;
+  int start, len, name, state;
+
+  posn = skipblanks(s, posn);
+  start = posn;
+  posn = skipident(s, posn);
+  len = posn - start;
+
+  // The null directive
+  if (len == 0 && s[posn] == 0)
+    return;
+
+  // Look for a file which is wholly inside #ifndef X ... #endif
+  if (f->guardstate == GUARD_CLOSED)
+    f->guardstate = GUARD_NONE;
+  if (f->guardstate == GUARD_START) {
+    f->guardstate = GUARD_NONE;
+    if (len == 6 && !strncmp(s + start, "ifndef", 6)) {
+      name = skipblanks(s, posn);
+      f->guard = strndup_(s + name, skipident(s, name) - name);
+      f->guardstate = GUARD_INSIDE;
+    }
+  }
+
+  // Conditionals are followed even when skipping lines
+  if ((len == 2 && !strncmp(s + start, "if", 2)) ||
+      (len == 5 && !strncmp(s + start, "ifdef", 5)) ||
+      (len == 6 && !strncmp(s + start, "ifndef", 6))) {
+    if (!active()) {
+      pushcond(IF_SKIPPING);
+      return;
+    }
+    if (len == 2)
+      state = evalif(s + posn);
+    else {
+      posn = skipblanks(s, posn);
+      if (!isidstart(s[posn]))
+        fatal("Identifier expected after #ifdef or #ifndef");
+      state = 0;
+      if (findmacro(s + posn, skipident(s, posn) - posn) != NULL ||
+          isbuiltin(s + posn, skipident(s, posn) - posn))
+        state = 1;
+      if (len == 6)
+        state = !state;
+    }
+    pushcond((state != 0) ? IF_TAKING : IF_SEEKING);
+    return;
+  }
+
+  if ((len == 4 && !strncmp(s + start, "elif", 4)) ||
+      (len == 4 && !strncmp(s + start, "else", 4))) {
+    if (Condlevel == f->condbase)
+      fatal("#elif or #else without #if");
+    if (Condelse[Condlevel - 1])
+      fatal("#elif or #else after #else");
+    if (f->guardstate == GUARD_INSIDE && Condlevel - 1 == f->condbase)
+      f->guardstate = GUARD_NONE;
+
+    state = Condstate[Condlevel - 1];
+    if (state == IF_TAKING)
+      state = IF_DONE;
+    else if (state == IF_SEEKING) {
+      if (s[start + 2] == 's' || evalif(s + posn))
+        state = IF_TAKING;
+    }
+    Condstate[Condlevel - 1] = state;
+    if (s[start + 2] == 's')
+      Condelse[Condlevel - 1] = 1;
+    return;
+  }
+
+  if (len == 5 && !strncmp(s + start, "endif", 5)) {
+    if (Condlevel == f->condbase)
+      fatal("#endif without #if");
+    Condlevel--;
+    if (f->guardstate == GUARD_INSIDE && Condlevel == f->condbase)
+      f->guardstate = GUARD_CLOSED;
+    return;
+  }
+
+  if (!active())
+    return;
+
+  if (len == 6 && !strncmp(s + start, "define", 6))
+    dodefine(s, posn);
+  else if (len == 5 && !strncmp(s + start, "undef", 5)) {
+    posn = skipblanks(s, posn);
+    undefmacro(s + posn, skipident(s, posn) - posn);
+  } else if (len == 7 && !strncmp(s + start, "include", 7))
+    doinclude(s, posn);
+  else if (len == 5 && !strncmp(s + start, "error", 5))
+    fatals("#error", s + skipblanks(s, posn));
+  // Apart from #pragma, which we ignore, anything else is an error
+  else if (len != 6 || strncmp(s + start, "pragma", 6))
+    fatals("Unknown preprocessor directive", strndup_(s + start, len));
+}
+
+int ppopen(char *filename) {
+  char *text;
+  int i;
+
+  if ((text = readfile(filename)) == NULL)
+    return -1;
+
+  if (Rawline == NULL) {
+    Rawline = newsb();
+    Joinline = newsb();
+    Outline = newsb();
+    Machash = (struct macro **) malloc(NMACROHASH * sizeof(struct macro *));
+    if (Machash == NULL)
+      fatal("Unable to malloc the macro hash index in ppopen");
+  }
+
+  // Each file starts with no macros defined
+  for (i = 0; i < NMACROHASH; i++)
+    Machash[i] = NULL;
+  Condlevel = 0;
+  Curfile = NULL;
+  Includedepth = 0;
+  pushfile(filename, text, NULL);
+  return 0;
+}
+
+char *ppline(void) {
+  struct srcfile *f;
+  int posn, startline;
+
+  while (Curfile != NULL) {
+    f = Curfile;
+    if (!readline())
+      popfile();
+    else {
+      Line = f->startline;
+      Infilename = f->name;
+
+      posn = skipblanks(Rawline->s, 0);
+      if (Rawline->s[posn] == '#')
+        directive(Rawline->s, posn + 1);
+
+      else if (Rawline->s[posn] != 0) {
+        // Anything outside a guard's #endif means there isn't one
+        if (f->guardstate != GUARD_INSIDE)
+          f->guardstate = GUARD_NONE;
+
+        if (active()) {
+          // Join lines until a macro call's arguments are complete
+          startline = f->startline;
+          sbreset(Joinline);
+          sbputs(Joinline, Rawline->s);
+          while (opencall(Joinline->s) && readline()) {
+            sbputc(Joinline, ' ');
+            sbputs(Joinline, Rawline->s);
+          }
+
+          sbreset(Outline);
+          expand(Joinline->s, Outline);
+          sbputc(Outline, '\n');
+          Line = startline;
+          return Outline->s;
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
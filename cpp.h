@@ -0,0 +1,5 @@
+// Start preprocessing the named file, returning -1 if it can't be read
+int ppopen(char *filename);
+// Return the next preprocessed line, ending in a newline,
+// or NULL at the end of the file
+char *ppline(void);
@@ -3,9 +3,7 @@
 
 extern int Line;
 extern int Putback;
-extern int Linestart;
 
-extern FILE *Infile;
 extern char *Infilename;
 
 extern FILE *Outfile;
@@ -30,9 +28,17 @@ extern struct symtable *Unionhead, *Uniontail;    // List of union types
 extern struct symtable *Enumhead, *Enumtail;      // List of enum types
 extern struct symtable *Typehead, *Typetail;      // List of typedefs
 
+// Memory arenas
+extern struct arena *Funcarena;   // Things which only live while compiling a function
+extern struct arena *Globarena;   // Things which live until the end of the file
+
 extern int O_dumpAST;     // Flag controlling debug output of AST trees
 extern int O_keepasm;		  // Flag controlling whether we keep any assembly files
 extern int O_assemble;		// Flag controlling whether we assemble the assembly files
 extern int O_dolink;		  // Whether we should link the object files
 extern int O_verbose;		  // Whether we should print info on compilation stages
 extern int O_dumpsym;		  // Whether the symbol table should be dumped at the end of every source code file
+extern int O_jobs;          // Number of input files to compile at once
+extern int O_peepstats;     // Whether to report what the peephole optimiser did
+extern int O_omitfp;        // Whether functions address their frame from %rsp
+extern int O_inlinelimit;   // Largest function body we inline, in AST nodes
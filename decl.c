@@ -1,9 +1,11 @@
 #include "data.h"
+#include "arena.h"
 #include "decl.h"
 #include "expr.h"
 #include "gen.h"
 #include "misc.h"
 #include "opt.h"
+#include "reach.h"
 #include "scan.h"
 #include "stmt.h"
 #include "sym.h"
@@ -368,7 +370,10 @@ static struct symtable *function_declaration(char *funcname, int type,
   // for the end label and add the fucntion to the symbol table
   if (oldfuncsym == NULL) {
     endlabel = genlabel();
-    newfuncsym = addglob(funcname, type, NULL, S_FUNCTION, C_GLOBAL, 0, endlabel);
+    // Only a static function is private to this file
+    if (class != C_STATIC)
+      class = C_GLOBAL;
+    newfuncsym = addglob(funcname, type, NULL, S_FUNCTION, class, 0, endlabel);
   }
 
   lparen();
@@ -424,9 +429,15 @@ static struct symtable *function_declaration(char *funcname, int type,
     fprintf(stdout, "\n\n");
   }
 
+  // Generating the tree changes it, so we look
+  // for the statics it refers to first
+  notefunction(tree);
   genAST(tree, NOLABEL, NOLABEL, NOLABEL, 0);
+  endfunction();
 
+  // The function's AST, locals and instructions are now dead
   freeloclsyms();
+  arenareset(Funcarena);
 
   return oldfuncsym;
 }
@@ -520,8 +531,10 @@ static struct symtable *array_declaration(char *varname, int type,
 
   sym->nelems = nelems;
   sym->size = sym->nelems * typesize(type, ctype);
-  if (class == C_GLOBAL || class == C_STATIC)
+  if (class == C_GLOBAL)
     genglobsym(sym);
+  else if (class == C_STATIC)
+    holdglobal(sym);
 
   return sym;
 }
@@ -574,8 +587,10 @@ static struct symtable *scalar_declaration(char *varname, int type,
     }
   }
 
-  if (class == C_GLOBAL || class == C_STATIC)
+  if (class == C_GLOBAL)
     genglobsym(sym);
+  else if (class == C_STATIC)
+    holdglobal(sym);
 
   return sym;
 }
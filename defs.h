@@ -9,7 +9,6 @@
 #define AOUT "a.out"
 #define ASCMD "as -o"
 #define LDCMD "cc -o"
-#define CPPCMD "cpp -nostdinc -isystem"
 
 struct token {
   int token;
@@ -82,9 +81,14 @@ struct symtable {
 #define st_endlabel st_posn    // End label for S_FUNCTIONs
   int st_posn;                 // Negative offset from the stack BP
                                // for locals
+  int st_reg;                  // Virtual register holding a local
+                               // or param kept in one, or NOREG
+  int st_addrtaken;            // Set if its address is taken
   int *initlist;               // List of initial values
   struct symtable *next;       // Next symbol on the list
   struct symtable *member;     // First member of a function, struct, union or enum
+  int hash;                    // Hash value of the name
+  struct symtable *hnext;      // Next symbol in the same hash bucket
 };
 
 // AST structure
@@ -101,6 +105,13 @@ struct ASTnode {
   int a_size;			          // For A_SCALE, the size to scale by
 };
 
+// A function whose calls can be replaced by its body
+struct inlinefunc {
+  struct symtable *sym;     // The function
+  struct ASTnode *body;     // The expression it returns
+  struct inlinefunc *next;
+};
+
 // Primitive types
 // Lower 4 btes encode the level of indirection,
 // e.g. 0b110000 is an int, whereas 0b110001 is an *int
@@ -135,3 +146,174 @@ enum {
   NOLABEL = 0   // Use NOLABEL when we have no label to
                 // pass to genAST
 };
+
+// x86-64 registers. The physical registers are numbered
+// as below, and anything from FIRSTVREG upwards is a
+// virtual register that the register allocator will map
+// onto one of the physical registers.
+enum {
+  R_RAX, R_RBX, R_RCX, R_RDX, R_RSI, R_RDI, R_RBP, R_RSP,
+  R_R8, R_R9, R_R10, R_R11, R_R12, R_R13, R_R14, R_R15,
+  FIRSTVREG
+};
+
+// Machine instruction opcodes
+enum {
+  I_LABEL, I_TEXT, I_MOV, I_MOVZB, I_MOVSL, I_LEA,
+  I_ADD, I_SUB, I_IMUL, I_AND, I_OR, I_XOR,
+  I_SHL, I_SHR, I_SAR, I_NEG, I_NOT, I_CMP, I_TEST,
+  I_SET, I_JMP, I_JCC, I_CALL, I_CQO, I_IDIV,
+  I_PUSH, I_POP, I_TAILCALL, I_CMOV
+};
+
+// Condition codes for I_SET, I_JCC and I_CMOV. The first six
+// line up with A_EQ .. A_GE, the last two are unsigned
+enum {
+  CC_E, CC_NE, CC_L, CC_G, CC_LE, CC_GE, CC_A, CC_BE
+};
+
+// Kinds of machine instruction operands
+enum {
+  OT_REG,       // A register
+  OT_IMM,       // An immediate value, e.g. $5
+  OT_MEM,       // Memory at a register plus displacement, e.g. -8(%rbp)
+  OT_GLOB,      // A global symbol, e.g. x(%rip)
+  OT_LABEL,     // A label as a jump target, e.g. L5
+  OT_LABREF,    // The address of a label, e.g. L5(%rip)
+  OT_SYM        // A symbol as a call or jump target
+};
+
+// Operand of a machine instruction
+struct operand {
+  int kind;           // The OT_ kind of operand
+  int reg;            // Register, or base register for OT_MEM
+  int index;          // Index register for OT_MEM, or NOREG
+  int scale;          // Scale applied to the index register
+  int size;           // Size of the register access in bytes
+  int val;            // Immediate value, displacement or label
+  char *name;         // Symbol name for OT_GLOB and OT_SYM
+};
+
+// A machine instruction in a function's instruction list
+struct insn {
+  int op;             // The I_ opcode
+  int size;           // Operand size for the mnemonic suffix, or 0.
+                      // Non-zero on an I_LABEL at the top of a loop
+  int cc;             // Condition code for I_SET, I_JCC and I_CMOV
+  int impuse;         // Mask of physical registers implicitly used
+  int impdef;         // Mask of physical registers implicitly set
+  char *text;         // Literal text for I_TEXT
+  struct operand *src;
+  struct operand *dst;
+  int *targets;       // Labels an indirect I_JMP can go to
+  int ntargets;       // Number of them
+  int block;          // Number of the basic block holding it
+  struct insn *prev;
+  struct insn *next;
+};
+
+// A basic block: a run of instructions which is only
+// entered at the top and only left at the bottom
+struct bblock {
+  int id;             // Position in the function, from zero
+  struct insn *first; // First and last instructions
+  struct insn *last;
+  int nsucc;          // The blocks control can go to next
+  struct bblock **succ;
+  int npred;          // The blocks control can come from
+  struct bblock **pred;
+  int *use;           // Registers read before being written
+  int *def;           // Registers written
+  int *livein;        // Registers live on entry
+  int *liveout;       // Registers live on exit
+  struct bblock *prev;
+  struct bblock *next;
+};
+
+// An expression worked out by an instruction in a basic
+// block, keyed on the value numbers of what it reads
+struct vexpr {
+  int op;             // The instruction's I_ opcode
+  int size;           // and size
+  int kind;           // Kind of its source operand, or -1
+  int a;              // Source register's value number, or constant
+  int b;              // Index register's value number, or -1
+  int scale;          // Scale and displacement of a memory source
+  int disp;
+  char *name;         // Name of a global source
+  int dst;            // Value number of the destination read, or -1
+  int mem;            // Memory version for a load, or -1
+  int vn;             // Value number of the result
+  struct vexpr *next;
+};
+
+// A static function or global variable. It is only written
+// out if a function which is written out refers to it.
+struct staticsym {
+  struct symtable *sym;
+  int used;                   // Set once we know it's needed
+  long start;                 // Where a static function's assembly
+  long end;                   // is held back, or -1
+  struct symtable **refs;     // Statics that a function refers to
+  int nrefs;
+  struct staticsym *next;
+};
+
+// A block of memory in an arena
+struct arenablock {
+  char *mem;                  // The memory itself
+  int size;                   // Its size in bytes
+  int used;                   // Number of bytes handed out
+  struct arenablock *next;
+};
+
+// A bump-pointer memory arena. Objects are never freed
+// one at a time; the whole arena is reset at once.
+struct arena {
+  struct arenablock *first;   // Chain of blocks, oldest first
+  struct arenablock *cur;     // Block we are allocating from
+  int inuse;                  // Bytes handed out since the last reset
+  int peak;                   // Most bytes ever in use at once
+};
+
+// A growable string used by the preprocessor
+struct strbuf {
+  char *s;                    // The string itself, always NUL terminated
+  int len;                    // Its length
+  int size;                   // Bytes allocated for it
+};
+
+// A preprocessor macro
+struct macro {
+  char *name;
+  int nparams;                // Number of parameters, -1 if object-like
+  char **params;              // Parameter names
+  char *body;                 // Replacement text
+  int variadic;               // True if the last parameter is ...
+  int disabled;               // Non-zero while being expanded
+  struct macro *next;         // Next in the hash chain
+};
+
+// A header file which has been read in. We keep
+// these for the whole run and note the include
+// guard macro of any header which has one.
+struct hdrcache {
+  char *path;                 // Where we found the header
+  char *text;                 // Its contents
+  char *guard;                // Its include guard macro, or NULL
+  struct hdrcache *next;
+};
+
+// A source file being preprocessed
+struct srcfile {
+  char *name;                 // Its name, for error messages
+  char *text;                 // Its contents
+  int posn;                   // Position of the next character in text
+  int line;                   // Line number of that character
+  int startline;              // Line on which the last logical line began
+  int condbase;               // Depth of the #if stack when we started
+  char *guard;                // Possible include guard macro
+  int guardstate;             // Include guard detection state
+  struct hdrcache *hdr;       // Cache entry if this is a header
+  struct srcfile *prev;       // File which included this one
+};
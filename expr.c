@@ -441,6 +441,8 @@ struct ASTnode *binexpr(int ptp) {
       case A_TERNARY:
         match(T_COLON, ":");
         ltemp = binexpr(0);
+        // The condition and both results are all rvalues
+        left->rvalue = right->rvalue = ltemp->rvalue = 1;
         // TODO: For the type, we should choose the wider of the TRUE and FALSE expressions
         return mkastnode(A_TERNARY, right->type, right->ctype, left, right, ltemp, NULL, 0);
       case A_ASSIGN:
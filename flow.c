@@ -0,0 +1,773 @@
+// Optimisations over a function's instruction list
+// while it still uses virtual registers
+//
+// Reading a variable which lives in a register copies it to a
+// new virtual register, as the code which uses the value may
+// change it in place. Most of the time it doesn't, so we
+// propagate the copies: the uses of the copy are rewritten to
+// use the variable's register, and the copy goes.
+//
+// The code generator also puts every constant and every value
+// loaded from memory in a register of its own. Where the one
+// instruction which reads such a register can take the constant
+// or the memory operand directly, we fold it in:
+//
+//   movq $1, %r11; addq %r11, %r10     becomes addq $1, %r10
+//   movslq -8(%rbp), %r11
+//   cmpl %r11d, %r10d                  becomes cmpl -8(%rbp), %r10d
+//
+// An address worked out with leaq goes into the memory
+// operands which use it:
+//
+//   leaq 8(%r10,%r11,4), %r12
+//   movslq (%r12), %r13                becomes movslq 8(%r10,%r11,4), %r13
+//   leaq Token(%rip), %r12
+//   movslq 4(%r12), %r13               becomes movslq Token+4(%rip), %r13
+//
+// Within each basic block we number the values held in
+// registers. An instruction which works out the same value from
+// the same inputs as an earlier one, where memory hasn't changed
+// in between for a load, becomes a copy of the earlier result:
+//
+//   movslq 4(%r10), %r11
+//   movslq 4(%r10), %r12               becomes movq %r11, %r12
+//
+// and the copy is then propagated away like the others.
+//
+// Then any move into a virtual register which is never read
+// is removed.
+
+#include "data.h"
+#include "arena.h"
+#include "cfg.h"
+#include "cg.h"
+#include "flow.h"
+
+// Number of times each virtual register is read and written
+static int *Nreads;
+static int *Nwrites;
+
+// Take an instruction off the list
+static void dropinsn(struct insn **head, struct insn *i) {
+  if (i->prev != NULL)
+    i->prev->next = i->next;
+  else
+    *head = i->next;
+  if (i->next != NULL)
+    i->next->prev = i->prev;
+}
+
+// Return true if the instruction reads register r
+static int reads(struct insn *i, int r) {
+  int regs[4];
+  int n, k;
+
+  n = insnuses(i, regs);
+  for (k = 0; k < n; k++)
+    if (regs[k] == r)
+      return 1;
+  return 0;
+}
+
+// Return true if the instruction writes register r
+static int writes(struct insn *i, int r) {
+  int regs[4];
+  int n, k;
+
+  n = insndefs(i, regs);
+  for (k = 0; k < n; k++)
+    if (regs[k] == r)
+      return 1;
+  return 0;
+}
+
+// Return a copy of the operand with register t
+// replaced by register v. Operands may be shared
+// between instructions, so we don't change them.
+static struct operand *renamereg(struct operand *o, int t, int v) {
+  int reg, index, scale;
+
+  if (o == NULL || (o->kind != OT_REG && o->kind != OT_MEM))
+    return o;
+  reg = o->reg;
+  index = o->index;
+  if (reg == t)
+    reg = v;
+  if (o->kind == OT_MEM && index == t)
+    index = v;
+  if (reg == o->reg && index == o->index)
+    return o;
+  scale = o->scale;
+  o = cgoperand(o->kind, reg, o->size, o->val, o->name);
+  o->index = index;
+  o->scale = scale;
+  return o;
+}
+
+// Return true if the instruction is a 64-bit move
+// from one virtual register to another
+static int isvcopy(struct insn *i) {
+  if (i->op != I_MOV || i->size != 8)
+    return 0;
+  if (i->src->kind != OT_REG || i->dst->kind != OT_REG)
+    return 0;
+  if (i->src->reg < FIRSTVREG || i->dst->reg < FIRSTVREG)
+    return 0;
+  return (i->src->reg != i->dst->reg);
+}
+
+// Try to remove the copy movq v, t at instruction i by using v
+// wherever t is read. This works if t isn't changed and isn't
+// needed after the block, and v isn't changed while t is read.
+// Return true if the copy was removed.
+static int propagate(struct insn **head, struct insn *i) {
+  struct bblock *b = insnblock(i);
+  struct insn *j, *stop;
+  int v = i->src->reg;
+  int t = i->dst->reg;
+
+  if (inset(b->liveout, t))
+    return 0;
+
+  // Find where v next changes, and check that t
+  // isn't read from there to the end of the block
+  stop = b->last->next;
+  for (j = i->next; j != b->last->next; j = j->next) {
+    if (writes(j, t))
+      return 0;
+    if (stop != b->last->next && reads(j, t))
+      return 0;
+    // An instruction which reads t as it changes v reads
+    // the old v, so it can still be rewritten
+    if (stop == b->last->next && writes(j, v))
+      stop = j->next;
+  }
+
+  for (j = i->next; j != stop; j = j->next) {
+    j->src = renamereg(j->src, t, v);
+    j->dst = renamereg(j->dst, t, v);
+  }
+  dropinsn(head, i);
+  return 1;
+}
+
+// Count the reads and writes of each virtual register
+static void countrefs(struct insn *head) {
+  struct insn *i;
+  int regs[4];
+  int n, k;
+
+  for (i = head; i != NULL; i = i->next) {
+    n = insnuses(i, regs);
+    for (k = 0; k < n; k++)
+      if (regs[k] >= FIRSTVREG)
+        Nreads[regs[k]] = Nreads[regs[k]] + 1;
+    n = insndefs(i, regs);
+    for (k = 0; k < n; k++)
+      if (regs[k] >= FIRSTVREG)
+        Nwrites[regs[k]] = Nwrites[regs[k]] + 1;
+  }
+}
+
+// Return true if the instruction's source
+// operand can be an immediate value
+static int takesimm(struct insn *i) {
+  switch (i->op) {
+    case I_MOV:
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_AND:
+    case I_OR:
+    case I_XOR:
+    case I_SHL:
+    case I_SHR:
+    case I_SAR:
+    case I_CMP:
+    case I_TEST:
+    case I_PUSH:
+    case I_MOVSL:
+    case I_MOVZB:
+      // Widening a constant gives a constant
+      return 1;
+  }
+  return 0;
+}
+
+// Return true if the instruction's source operand
+// can be in memory, given its destination
+static int takesmem(struct insn *i) {
+  switch (i->op) {
+    case I_MOV:
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_AND:
+    case I_OR:
+    case I_XOR:
+    case I_CMP:
+      return (i->dst->kind == OT_REG);
+  }
+  return 0;
+}
+
+// Return true if the instruction's source is register r
+static int srcis(struct insn *i, int r) {
+  if (i->src == NULL || i->src->kind != OT_REG)
+    return 0;
+  return (i->src->reg == r);
+}
+
+// Return true if the instruction's destination
+// operand names register r, e.g. testq r, r
+static int dstnames(struct insn *i, int r) {
+  if (i->dst == NULL)
+    return 0;
+  if (i->dst->kind != OT_REG && i->dst->kind != OT_MEM)
+    return 0;
+  if (i->dst->kind == OT_MEM && i->dst->index == r)
+    return 1;
+  return (i->dst->reg == r);
+}
+
+// Return true if the instruction may change memory
+static int writesmem(struct insn *i) {
+  switch (i->op) {
+    case I_CALL:
+    case I_PUSH:
+    case I_TEXT:
+      return 1;
+    case I_CMP:
+    case I_TEST:
+      return 0;
+  }
+  if (i->dst == NULL)
+    return 0;
+  return (i->dst->kind == OT_MEM || i->dst->kind == OT_GLOB);
+}
+
+// Value numbering
+
+#define VNHASHSIZE 64           // Buckets in the expression table
+
+static int *Vn;                 // Value number held by each register
+static int *Vnblock;            // Block it was set in, plus one
+static int *Holder;             // A register holding each value number
+static int Nvn;                 // Number of value numbers handed out
+static int Curblock;            // Block being numbered, plus one
+static int Memver;              // Changed whenever memory may change
+static struct vexpr *Vexprs[VNHASHSIZE];
+static int Ncse;                // Instructions made into copies
+
+// Give a new value number to register r
+static int newvn(int r) {
+  Vn[r] = Nvn;
+  Vnblock[r] = Curblock;
+  Holder[Nvn] = r;
+  Nvn++;
+  return Vn[r];
+}
+
+// Return the value number of register r. One which hasn't
+// been set in this block holds a value we know nothing about.
+static int vnof(int r) {
+  if (Vnblock[r] != Curblock)
+    return newvn(r);
+  return Vn[r];
+}
+
+// Return true if register r still holds value number vn
+static int stillholds(int r, int vn) {
+  return (Vnblock[r] == Curblock && Vn[r] == vn);
+}
+
+// Return true if the instruction works out its destination
+// from its operands alone, so that the same instruction on the
+// same values gives the same result. Byte and word operations
+// leave the rest of the register alone, so we skip them.
+static int numberable(struct insn *i) {
+  switch (i->op) {
+    case I_MOV:
+      // A constant costs no more to load again, and a 64-bit
+      // move between registers is a copy
+      if (i->src->kind == OT_IMM)
+        return 0;
+      if (i->src->kind == OT_REG && i->size == 8)
+        return 0;
+      break;
+    case I_LEA:
+      // Nor does a %rip-relative address
+      if (i->src->kind != OT_MEM)
+        return 0;
+      break;
+    case I_MOVSL:
+    case I_MOVZB:
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_AND:
+    case I_OR:
+    case I_XOR:
+    case I_SHL:
+    case I_SHR:
+    case I_SAR:
+    case I_NEG:
+    case I_NOT:
+      break;
+    default:
+      return 0;
+  }
+  if (i->impuse != 0 || i->impdef != 0 || i->size < 4)
+    return 0;
+  return (i->dst->kind == OT_REG && i->dst->reg >= FIRSTVREG);
+}
+
+// Return true if the instruction changes its destination
+// in place, so the old value is one of its inputs
+static int inplace(int op) {
+  switch (op) {
+    case I_MOV:
+    case I_MOVSL:
+    case I_MOVZB:
+    case I_LEA:
+      return 0;
+  }
+  return 1;
+}
+
+// Return true if the operation gives the same
+// result with its operands swapped
+static int commutes(int op) {
+  switch (op) {
+    case I_ADD:
+    case I_IMUL:
+    case I_AND:
+    case I_OR:
+    case I_XOR:
+      return 1;
+  }
+  return 0;
+}
+
+// Build the key for the expression worked out by instruction i
+static struct vexpr *vnexpr(struct insn *i) {
+  struct vexpr *e;
+  struct operand *o = i->src;
+  int tmp;
+
+  e = (struct vexpr *) arenaalloc(Funcarena, sizeof(struct vexpr));
+  e->op = i->op;
+  e->size = i->size;
+  e->kind = -1;
+  e->b = -1;
+  e->dst = -1;
+  e->mem = -1;
+  if (o != NULL) {
+    e->kind = o->kind;
+    e->a = o->val;
+    e->scale = o->scale;
+    e->disp = o->val;
+    e->name = o->name;
+    if (o->kind == OT_REG || o->kind == OT_MEM)
+      e->a = vnof(o->reg);
+    if (o->kind == OT_MEM && o->index != NOREG)
+      e->b = vnof(o->index);
+    // leaq only works out the address
+    if ((o->kind == OT_MEM || o->kind == OT_GLOB) && i->op != I_LEA)
+      e->mem = Memver;
+  }
+  if (inplace(i->op))
+    e->dst = vnof(i->dst->reg);
+  if (commutes(i->op) && e->kind == OT_REG && e->a > e->dst) {
+    tmp = e->a;
+    e->a = e->dst;
+    e->dst = tmp;
+  }
+  return e;
+}
+
+// Return the bucket for an expression
+static int vnhash(struct vexpr *e) {
+  int h;
+
+  h = e->op * 31 + e->a * 17 + e->b * 13 + e->disp * 7 + e->dst * 5 + e->mem;
+  h = h % VNHASHSIZE;
+  if (h < 0)
+    h = h + VNHASHSIZE;
+  return h;
+}
+
+// Return true if the two expressions are the same
+static int sameexpr(struct vexpr *e, struct vexpr *f) {
+  if (e->op != f->op || e->size != f->size || e->kind != f->kind)
+    return 0;
+  if (e->a != f->a || e->b != f->b || e->dst != f->dst || e->mem != f->mem)
+    return 0;
+  if (e->scale != f->scale || e->disp != f->disp)
+    return 0;
+  if (e->name == NULL && f->name == NULL)
+    return 1;
+  if (e->name == NULL || f->name == NULL)
+    return 0;
+  return (!strcmp(e->name, f->name));
+}
+
+// Number the value worked out by instruction i. If it
+// is already in a virtual register, make i a copy of it.
+static void numberinsn(struct insn *i) {
+  struct vexpr *e, *f;
+  int h, r;
+  int t = i->dst->reg;
+
+  e = vnexpr(i);
+  h = vnhash(e);
+  for (f = Vexprs[h]; f != NULL; f = f->next) {
+    if (sameexpr(e, f)) {
+      r = Holder[f->vn];
+      if (r != t && r >= FIRSTVREG && stillholds(r, f->vn)) {
+        i->op = I_MOV;
+        i->size = 8;
+        i->src = cgoperand(OT_REG, r, 8, 0, NULL);
+        i->dst = cgoperand(OT_REG, t, 8, 0, NULL);
+        Vn[t] = f->vn;
+        Vnblock[t] = Curblock;
+        Ncse++;
+        return;
+      }
+      break;
+    }
+  }
+
+  e->vn = newvn(t);
+  e->next = Vexprs[h];
+  Vexprs[h] = e;
+}
+
+// A copy holds the same value as its source. Keep the
+// value in a virtual register if we can.
+static void numbercopy(struct insn *i) {
+  int vn, r;
+
+  vn = vnof(i->src->reg);
+  Vn[i->dst->reg] = vn;
+  Vnblock[i->dst->reg] = Curblock;
+  r = Holder[vn];
+  if (i->dst->reg >= FIRSTVREG && (r < FIRSTVREG || !stillholds(r, vn)))
+    Holder[vn] = i->dst->reg;
+}
+
+// Any other instruction leaves values in the registers
+// it sets, and maybe in memory, that we know nothing about
+static void forgetdefs(struct insn *i) {
+  int regs[4];
+  int n, k;
+
+  n = insndefs(i, regs);
+  for (k = 0; k < n; k++)
+    Vnblock[regs[k]] = 0;
+  for (k = 0; k < FIRSTVREG; k++)
+    if (i->impdef & (1 << k))
+      Vnblock[k] = 0;
+  if (writesmem(i))
+    Memver++;
+}
+
+// Number the values in one basic block
+static void numberblock(struct bblock *b) {
+  struct insn *i;
+  int k;
+
+  Curblock = b->id + 1;
+  for (k = 0; k < VNHASHSIZE; k++)
+    Vexprs[k] = NULL;
+
+  for (i = b->first; i != b->last->next; i = i->next) {
+    if (numberable(i))
+      numberinsn(i);
+    else if (i->op == I_MOV && i->size == 8 && i->src->kind == OT_REG &&
+             i->dst->kind == OT_REG)
+      numbercopy(i);
+    else
+      forgetdefs(i);
+  }
+}
+
+// Number the values in each block of a function,
+// and return how many instructions became copies
+static int valuenumber(struct insn *head, struct bblock *first, int nvregs) {
+  struct bblock *b;
+  struct insn *i;
+  int n = nvregs;
+
+  for (i = head; i != NULL; i = i->next)
+    n = n + 5;
+  Vn = (int *) arenaalloc(Funcarena, nvregs * sizeof(int));
+  Vnblock = (int *) arenaalloc(Funcarena, nvregs * sizeof(int));
+  Holder = (int *) arenaalloc(Funcarena, n * sizeof(int));
+  Nvn = 0;
+  Ncse = 0;
+  for (b = first; b != NULL; b = b->next)
+    numberblock(b);
+  return Ncse;
+}
+
+// The constant in movq $5, t is put in the instructions which
+// read t, when they can all take an immediate
+static void foldimm(struct insn **head, struct insn *i) {
+  struct insn *j;
+  int t = i->dst->reg;
+
+  for (j = *head; j != NULL; j = j->next) {
+    if (reads(j, t)) {
+      if (!srcis(j, t) || !takesimm(j) || dstnames(j, t))
+        return;
+      // A byte operation can't take a larger constant
+      if (j->size == 1 && (i->src->val < -128 || i->src->val > 255))
+        return;
+    }
+  }
+
+  for (j = *head; j != NULL; j = j->next) {
+    if (reads(j, t)) {
+      j->src = i->src;
+      if (j->op == I_MOVZB)
+        j->src = cgoperand(OT_IMM, NOREG, 0, i->src->val & 0xff, NULL);
+      if (j->op == I_MOVSL || j->op == I_MOVZB)
+        j->op = I_MOV;
+    }
+  }
+  Nreads[t] = 0;
+}
+
+// Return true if a load into a register of the given
+// size can be used by an instruction of size usesize
+static int loadfits(int op, int loadsize, int usesize) {
+  if (op == I_MOV)
+    return (usesize <= loadsize);
+  // movslq and movzbq: only the bytes loaded
+  return (usesize == loadsize);
+}
+
+// The memory operand of a load into t is put in the one
+// instruction which reads t, if it comes later in the
+// same block and nothing in between may change memory
+static void foldload(struct insn *i) {
+  struct bblock *b = insnblock(i);
+  struct insn *j;
+  int t = i->dst->reg;
+  int loadsize = 8;
+
+  if (i->op == I_MOVSL)
+    loadsize = 4;
+  if (i->op == I_MOVZB)
+    loadsize = 1;
+
+  for (j = i->next; j != b->last->next; j = j->next) {
+    if (reads(j, t)) {
+      if (!srcis(j, t) || !takesmem(j) || dstnames(j, t) ||
+          !loadfits(i->op, loadsize, j->size))
+        return;
+      // movq mem, t; movq t, u only saves a register
+      // if the sizes are the same
+      if (j->op == I_MOV && (i->op != I_MOV || j->size != 8))
+        return;
+      j->src = i->src;
+      Nreads[t] = 0;
+      return;
+    }
+    if (writesmem(j))
+      return;
+  }
+}
+
+// Return the operand o with register t as its base
+// replaced by the address in addr, or NULL if the
+// two can't be put in one operand
+static struct operand *mergeaddr(struct operand *o, int t,
+                                 struct operand *addr) {
+  struct operand *new;
+
+  if (o->index != NOREG && addr->index != NOREG)
+    return NULL;
+  // A global is addressed from %rip, which can't have an index
+  if (addr->kind == OT_GLOB) {
+    if (o->index != NOREG)
+      return NULL;
+    new = cgoperand(OT_GLOB, NOREG, o->size, o->val + addr->val, addr->name);
+    return new;
+  }
+  new = cgoperand(OT_MEM, addr->reg, o->size, o->val + addr->val, NULL);
+  new->index = addr->index;
+  new->scale = addr->scale;
+  if (o->index != NOREG) {
+    new->index = o->index;
+    new->scale = o->scale;
+  }
+  return new;
+}
+
+// Return true if the operand is memory addressed from register t.
+// If it is, it must be the base, as an index is scaled.
+static int addrfrom(struct operand *o, int t) {
+  if (o == NULL || o->kind != OT_MEM)
+    return 0;
+  return (o->reg == t && o->index != t);
+}
+
+// The address in leaq addr, t is put in the memory operands of
+// the instructions which read t, when they are all later in the
+// same block and nothing in between changes addr's registers
+static void foldlea(struct insn *i) {
+  struct bblock *b = insnblock(i);
+  struct insn *j, *last = NULL;
+  struct operand *src, *dst;
+  int t = i->dst->reg;
+  int base = i->src->reg;
+  int index = i->src->index;
+  int n = 0;
+
+  for (j = i->next; j != b->last->next && n < Nreads[t]; j = j->next) {
+    if (reads(j, t)) {
+      if (!addrfrom(j->src, t) && !addrfrom(j->dst, t))
+        return;
+      if (addrfrom(j->src, t) && mergeaddr(j->src, t, i->src) == NULL)
+        return;
+      if (addrfrom(j->dst, t) && mergeaddr(j->dst, t, i->src) == NULL)
+        return;
+      n++;
+      last = j;
+    }
+    if (n < Nreads[t] && (writes(j, base) || writes(j, index)))
+      return;
+  }
+  if (n != Nreads[t])
+    return;
+
+  for (j = i->next; j != last->next; j = j->next) {
+    src = j->src;
+    dst = j->dst;
+    if (addrfrom(src, t))
+      j->src = mergeaddr(src, t, i->src);
+    if (addrfrom(dst, t))
+      j->dst = mergeaddr(dst, t, i->src);
+    if (src != j->src || dst != j->dst) {
+      // The registers in the address are now read here
+      if (base >= FIRSTVREG)
+        Nreads[base] = Nreads[base] + 1;
+      if (index >= FIRSTVREG)
+        Nreads[index] = Nreads[index] + 1;
+    }
+  }
+  Nreads[t] = 0;
+}
+
+// Return true if the instruction puts an address in a
+// virtual register which is written only there
+static int isfoldlea(struct insn *i) {
+  if (i->op != I_LEA)
+    return 0;
+  if (i->src->kind != OT_MEM && i->src->kind != OT_GLOB)
+    return 0;
+  if (i->dst->kind != OT_REG || i->dst->reg < FIRSTVREG)
+    return 0;
+  return (Nwrites[i->dst->reg] == 1 && Nreads[i->dst->reg] > 0);
+}
+
+// Return true if the instruction loads a frame slot or
+// a global into a virtual register written only there
+// and read once
+static int isfoldload(struct insn *i) {
+  if (i->op != I_MOV && i->op != I_MOVSL && i->op != I_MOVZB)
+    return 0;
+  if (i->dst->kind != OT_REG || i->dst->reg < FIRSTVREG)
+    return 0;
+  // A slot in a local array has an index, which may change
+  if (i->src->kind != OT_GLOB &&
+      (i->src->kind != OT_MEM || i->src->reg != R_RBP ||
+       i->src->index != NOREG))
+    return 0;
+  if (i->size != 8 || Nwrites[i->dst->reg] != 1)
+    return 0;
+  return (Nreads[i->dst->reg] == 1);
+}
+
+// Return true if the instruction puts a constant in
+// a virtual register which is written only there
+static int isconstant(struct insn *i) {
+  if (i->op != I_MOV || i->src->kind != OT_IMM)
+    return 0;
+  if (i->dst->kind != OT_REG || i->dst->reg < FIRSTVREG)
+    return 0;
+  return (Nwrites[i->dst->reg] == 1);
+}
+
+// Return true if the instruction only moves a value
+// into a virtual register which is never read
+static int isdeadmove(struct insn *i) {
+  if (i->op != I_MOV && i->op != I_MOVZB && i->op != I_MOVSL &&
+      i->op != I_LEA)
+    return 0;
+  if (i->dst->kind != OT_REG || i->dst->reg < FIRSTVREG)
+    return 0;
+  return (Nreads[i->dst->reg] == 0);
+}
+
+// Remove the moves into virtual registers which are never
+// read. Removing one may leave its source unread too.
+static void deadmoves(struct insn **head) {
+  struct insn *i, *next;
+  int regs[4];
+  int n, k, changed = 1;
+
+  while (changed) {
+    changed = 0;
+    for (i = *head; i != NULL; i = next) {
+      next = i->next;
+      if (isdeadmove(i)) {
+        n = insnuses(i, regs);
+        for (k = 0; k < n; k++)
+          if (regs[k] >= FIRSTVREG)
+            Nreads[regs[k]] = Nreads[regs[k]] - 1;
+        dropinsn(head, i);
+        changed = 1;
+      }
+    }
+  }
+}
+
+// Propagate the copies between virtual registers
+static void propagateall(struct insn **head) {
+  struct insn *i, *next;
+
+  for (i = *head; i != NULL; i = next) {
+    next = i->next;
+    if (isvcopy(i))
+      propagate(head, i);
+  }
+}
+
+void flowopt(struct insn **head, int nvregs) {
+  struct bblock *first;
+  struct insn *i;
+
+  first = buildcfg(*head);
+  liveness(first, nvregs);
+  propagateall(head);
+  // Numbering turns repeated work into copies, which
+  // the liveness found above still covers
+  if (valuenumber(*head, first, nvregs))
+    propagateall(head);
+
+  Nreads = (int *) arenaalloc(Funcarena, nvregs * sizeof(int));
+  Nwrites = (int *) arenaalloc(Funcarena, nvregs * sizeof(int));
+  countrefs(*head);
+  for (i = *head; i != NULL; i = i->next) {
+    if (isconstant(i))
+      foldimm(head, i);
+    if (isfoldlea(i))
+      foldlea(i);
+    if (isfoldload(i))
+      foldload(i);
+  }
+  deadmoves(head);
+}
@@ -0,0 +1,4 @@
+// Propagate copies between virtual registers and remove
+// the moves whose results are never read, before the
+// function's registers are allocated
+void flowopt(struct insn **head, int nvregs);
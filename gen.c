@@ -4,6 +4,8 @@
 #include "cg.h"
 #include "gen.h"
 #include "misc.h"
+#include "opt.h"
+#include "types.h"
 
 static int labelid = 1;
 
@@ -13,11 +15,115 @@ int genlabel(void) {
   return labelid++;
 }
 
+// The comparison which is true when each of A_EQ .. A_GE is false
+static int cmpinvert[] = {A_NE, A_EQ, A_GE, A_LE, A_GT, A_LT};
+
+// Generate code for the condition n which jumps to the
+// label when the condition is true, if sense is 1, or when
+// it is false, if sense is 0, and otherwise falls through.
+// The && and || operators become jumps between their operands,
+// so a condition never has to build a 0 or 1 in a register.
+static void gencond(struct ASTnode *n, int label, int sense) {
+  int Lskip, early, leftreg, rightreg, op;
+
+  switch (n->op) {
+    case A_TOBOOL:
+      gencond(n->left, label, sense);
+      return;
+    case A_LOGNOT:
+      gencond(n->left, label, !sense);
+      return;
+    case A_LOGAND:
+    case A_LOGOR:
+      // && can stop early when its left side is
+      // false, and || when its left side is true
+      early = 0;
+      if (n->op == A_LOGOR)
+        early = 1;
+      if (sense == early) {
+        gencond(n->left, label, sense);
+        gencond(n->right, label, sense);
+      } else {
+        Lskip = genlabel();
+        gencond(n->left, Lskip, early);
+        gencond(n->right, label, sense);
+        cglabel(Lskip);
+      }
+      return;
+    case A_INTLIT:
+      // A constant condition either always jumps or never does
+      if (n->a_intvalue != 0 && sense == 1)
+        cgjump(label);
+      if (n->a_intvalue == 0 && sense == 0)
+        cgjump(label);
+      return;
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+      leftreg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
+      rightreg = genAST(n->right, NOLABEL, NOLABEL, NOLABEL, n->op);
+      // cgcompare_and_jump() jumps when the comparison is false
+      op = n->op;
+      if (sense == 1)
+        op = cmpinvert[op - A_EQ];
+      cgcompare_and_jump(op, leftreg, rightreg, label, n->left->type);
+      return;
+  }
+
+  // Anything else is true when it isn't zero
+  leftreg = genAST(n, NOLABEL, NOLABEL, NOLABEL, 0);
+  if (sense == 1)
+    cgboolean(leftreg, A_LOGOR, label);
+  else
+    cgboolean(leftreg, A_LOGAND, label);
+}
+
+// Return true if the condition is most likely false. We guess
+// as in Ball and Larus' static branch prediction: pointers are
+// seldom NULL, and values are seldom negative.
+static int unlikely(struct ASTnode *n) {
+  switch (n->op) {
+    case A_TOBOOL:
+      return unlikely(n->left);
+    case A_LOGNOT:
+      return ptrtype(n->left->type);
+    case A_LOGAND:
+      return (unlikely(n->left) || unlikely(n->right));
+    case A_LOGOR:
+      return (unlikely(n->left) && unlikely(n->right));
+    case A_EQ:
+      if (n->right->op != A_INTLIT || n->right->a_intvalue != 0)
+        return 0;
+      return ptrtype(n->left->type);
+    case A_LT:
+    case A_LE:
+      return (n->right->op == A_INTLIT && n->right->a_intvalue == 0);
+  }
+  return 0;
+}
+
 // Generate code for an IF statement and an
 // optional ELSE clause
 static int genIF(struct ASTnode *n, int looptoplabel, int loopendlabel) {
   int Lfalse, Lend;
 
+  // Put the ELSE clause first if it is the likely one,
+  // so that the usual path falls through
+  if (n->right && unlikely(n->left)) {
+    Lfalse = genlabel();
+    Lend = genlabel();
+    gencond(n->left, Lfalse, 1);
+    genAST(n->right, NOLABEL, looptoplabel, loopendlabel, n->op);
+    cgjump(Lend);
+    cglabel(Lfalse);
+    genAST(n->mid, NOLABEL, looptoplabel, loopendlabel, n->op);
+    cglabel(Lend);
+    return NOREG;
+  }
+
   // Generate two labels, one for the false
   // compound statement, and another one for
   // the end of the overall if statement.
@@ -30,13 +136,10 @@ static int genIF(struct ASTnode *n, int looptoplabel, int loopendlabel) {
   // Generate the condition code followed by a
   // jump to the false label if the condition
   // evaluates to 0
-  // Note: We cheat by passing the label as a register
-  genAST(n->left, Lfalse, NOLABEL, NOLABEL, n->op);
-  genfreeregs(NOREG);
+  gencond(n->left, Lfalse, 0);
 
   // Generate the statement for the TRUE clause
   genAST(n->mid, NOLABEL, looptoplabel, loopendlabel, n->op);
-  genfreeregs(NOREG);
 
   // If there exists an ELSE clause, we skip it
   // by jumping to the end
@@ -49,122 +152,395 @@ static int genIF(struct ASTnode *n, int looptoplabel, int loopendlabel) {
   // Generate the false statement and the end label
   if (n->right) {
     genAST(n->right, NOLABEL, NOLABEL, loopendlabel, n->op);
-    genfreeregs(NOREG);
     cglabel(Lend);
   }
 
   return NOREG;
 }
 
+// Return the number of nodes in a tree
+static int treesize(struct ASTnode *n) {
+  if (n == NULL)
+    return 0;
+  return 1 + treesize(n->left) + treesize(n->mid) + treesize(n->right);
+}
+
+// Generate a loop with its test at the bottom, so that each
+// time round it takes just the one branch back to the top:
+//
+//        test, jump to Lend if false     or    jmp Ltest
+//  Lstart:
+//        body
+//  Ltest:
+//        test, jump to Lstart if true
+//  Lend:
+//
+// A small test is copied to guard the way into the loop,
+// otherwise we jump to the test at the bottom.
 static int genWHILE(struct ASTnode *n) {
-  int Lstart, Lend;
+  int Lstart, Ltest, Lend;
 
-  // Generate the start and end labels
-  // and output the start label
   Lstart = genlabel();
+  Ltest = genlabel();
   Lend = genlabel();
-  cglabel(Lstart);
 
-  // Generate the code for the conditional
-  // followed by a jump to the end.
-  genAST(n->left, Lend, Lstart, Lend, n->op);
-  genfreeregs(NOREG);
+  // Generating a tree can change it, so we copy it first
+  if (treesize(n->left) <= 8)
+    gencond(copytree(n->left), Lend, 0);
+  else
+    cgjump(Ltest);
 
-  // Generate code for the body
-  genAST(n->right, NOLABEL, Lstart, Lend, n->op);
-  genfreeregs(NOREG);
+  // Generate code for the body. A continue goes to the test.
+  cglooplabel(Lstart);
+  genAST(n->right, NOLABEL, Ltest, Lend, n->op);
 
-  // Output the jump to the beginning of the loop
-  cgjump(Lstart);
-  // Output the end label
+  // Output the test, going back to the start if it's true
+  cglabel(Ltest);
+  gencond(n->left, Lstart, 1);
   cglabel(Lend);
 
   return NOREG;
 }
 
+// Return the number of arguments in a function call
+static int numargs(struct ASTnode *n) {
+  // The first gluetree we encounter is
+  // the one with the biggest count
+  if (n->left == NULL)
+    return 0;
+  return n->left->a_size;
+}
+
+// Evaluate the arguments of a function call and return
+// a list with the register holding the nth one at n
+static int *genargs(struct ASTnode *n) {
+  struct ASTnode *gluetree = n->left;
+  int *argreg;
+
+  argreg = (int *) malloc((numargs(n) + 1) * sizeof(int));
+
+  // Evaluate all of the arguments before we copy any of
+  // them, as an argument may itself contain a function call
+  while (gluetree) {
+    // The size param indicates that this the nth argument
+    // to be passed to the function
+    argreg[gluetree->a_size] =
+      genAST(gluetree->right, NOLABEL, NOLABEL, NOLABEL, gluetree->op);
+    gluetree = gluetree->left;
+  }
+  return argreg;
+}
+
 // Generate code to copy the arguments of a
 // function call to the right places, then
 // invoke the function itself. Return the
 // register that holds the function's return
 // value.
 static int gen_funccall(struct ASTnode *n) {
-  struct ASTnode *gluetree = n->left;
-  int reg;
-  int numargs = 0;
+  int *argreg;
+  int i;
 
-  // Save registers before we copy the arguments
-  spill_all_regs();
+  argreg = genargs(n);
+  for (i = numargs(n); i > 0; i--)
+    cgcopyarg(argreg[i], i);
+  free(argreg);
 
-  while (gluetree) {
-    reg = genAST(gluetree->right, NOLABEL, NOLABEL, NOLABEL, gluetree->op);
-    // The size param indicates that this the nth argument
-    // to be passed to the function
-    cgcopyarg(reg, gluetree->a_size);
+  return cgcall(n->sym, numargs(n));
+}
 
-    // Note down the total number of arguments (first gluetree
-    // we encounter is the one with the biggest count)
-    if (numargs == 0)
-      numargs = gluetree->a_size;
+// Set when nothing can point into the current function's
+// frame, so that a call in return position doesn't need it
+static int Tailcalls;
 
-    gluetree = gluetree->left;
+// Label at the start of the current function's body, where
+// a call of the function to itself in return position goes
+static int Startlabel;
+
+// Return true if the local or param is a scalar
+// whose address is never taken
+static int privatevar(struct symtable *sym) {
+  if (sym->stype != S_VARIABLE || sym->st_addrtaken)
+    return 0;
+  return (inttype(sym->type) || ptrtype(sym->type));
+}
+
+// Return true if nothing can point into the function's frame
+static int framesafe(struct symtable *func) {
+  struct symtable *sym;
+
+  for (sym = func->member; sym != NULL; sym = sym->next)
+    if (!privatevar(sym))
+      return 0;
+  for (sym = Loclhead; sym != NULL; sym = sym->next)
+    if (!privatevar(sym))
+      return 0;
+  return 1;
+}
+
+// Return true if the A_RETURN node returns what a
+// call gives back, and the call can be a tail call
+static int istailcall(struct ASTnode *n) {
+  struct ASTnode *call = n->left;
+
+  if (!Tailcalls || call == NULL || call->op != A_FUNCCALL)
+    return 0;
+  if (call->sym == Functionid)
+    return (numargs(call) == Functionid->nelems);
+  // The arguments all have to go in registers
+  return (numargs(call) <= 6);
+}
+
+// Return true if the tree has a tail call
+// of the current function to itself
+static int hasselftail(struct ASTnode *n) {
+  if (n == NULL)
+    return 0;
+  if (n->op == A_RETURN && istailcall(n) && n->left->sym == Functionid)
+    return 1;
+  return (hasselftail(n->left) || hasselftail(n->mid) ||
+          hasselftail(n->right));
+}
+
+// Generate the call in a return statement as a tail call.
+// A call of the function to itself sets the params to the
+// arguments and goes back to the start of the body. Any other
+// call leaves the function by jumping to the callee, which
+// then returns straight to our caller.
+static void gen_tailcall(struct ASTnode *n) {
+  struct ASTnode *call = n->left;
+  struct symtable *parm;
+  int *argreg;
+  int i;
+
+  argreg = genargs(call);
+  if (call->sym == Functionid) {
+    for (parm = Functionid->member, i = 1; parm != NULL;
+         parm = parm->next, i++)
+      cgstorlocal(argreg[i], parm);
+    cgjump(Startlabel);
+  } else {
+    for (i = numargs(call); i > 0; i--)
+      cgcopyarg(argreg[i], i);
+    cgtailcall(call->sym, numargs(call));
+  }
+  free(argreg);
+}
+
+// A switch with at least this many cases, whose values span
+// no more than SWITCHDENSITY slots per case, uses a jump table
+#define SWITCHTABLEMIN 4
+#define SWITCHDENSITY 3
+
+// Dispatch on the sorted case values lo..hi with a binary
+// search, comparing against a short run of cases in turn
+static void gencasetree(int reg, int *caseval, int *caselabel,
+                        int lo, int hi, int defaultlabel) {
+  int mid, Lleft;
+
+  if (hi - lo < 3) {
+    while (lo <= hi) {
+      cgcmpimm(reg, caseval[lo]);
+      cgjcc(CC_E, caselabel[lo]);
+      lo++;
+    }
+    cgjump(defaultlabel);
+    return;
+  }
+
+  // Test the middle case, then search one half or the other
+  mid = (lo + hi) / 2;
+  Lleft = genlabel();
+  cgcmpimm(reg, caseval[mid]);
+  cgjcc(CC_E, caselabel[mid]);
+  cgjcc(CC_L, Lleft);
+  gencasetree(reg, caseval, caselabel, mid + 1, hi, defaultlabel);
+  cglabel(Lleft);
+  gencasetree(reg, caseval, caselabel, lo, mid - 1, defaultlabel);
+}
+
+// Jump to the case matching the value in reg. Dense case
+// values go through a jump table, sparse ones are found
+// with a binary search.
+static void gencasedispatch(int reg, int *caseval, int *caselabel,
+                            int casecount, int defaultlabel) {
+  int *table;
+  int i, j, val, label, count;
+  long range;
+
+  if (casecount == 0) {
+    cgjump(defaultlabel);
+    return;
+  }
+
+  // Sort the cases by value
+  for (i = 1; i < casecount; i++) {
+    val = caseval[i];
+    label = caselabel[i];
+    for (j = i; j > 0 && caseval[j - 1] > val; j--) {
+      caseval[j] = caseval[j - 1];
+      caselabel[j] = caselabel[j - 1];
+    }
+    caseval[j] = val;
+    caselabel[j] = label;
+  }
+
+  range = (long) caseval[casecount - 1] - caseval[0] + 1;
+  if (casecount < SWITCHTABLEMIN || range > SWITCHDENSITY * casecount) {
+    gencasetree(reg, caseval, caselabel, 0, casecount - 1, defaultlabel);
+    return;
   }
 
-  return cgcall(n->sym, numargs);
+  // Fill the gaps in the table with the default label
+  count = (int) range;
+  table = (int *) malloc(count * sizeof(int));
+  for (i = 0; i < count; i++)
+    table[i] = defaultlabel;
+  for (i = 0; i < casecount; i++)
+    table[caseval[i] - caseval[0]] = caselabel[i];
+
+  cgjumptable(reg, caseval[0], count, table, defaultlabel);
+  free(table);
 }
 
 static int genSWITCH(struct ASTnode *n) {
-  int *caseval, *caselabel;
-  int Ljumptop, Lend;
-  int i, reg, defaultlabel = 0, casecount = 0;
+  int *caseval, *caselabel, *label;
+  int Lend;
+  int i, reg, defaultlabel, casecount = 0;
   struct ASTnode *c;
 
   // Create arrays for case values and their corresponding
-  // labels.
+  // labels, and for the label of each case in order.
   caseval = (int *) malloc((n->a_intvalue + 1) * sizeof(int));
   caselabel = (int *) malloc((n->a_intvalue + 1) * sizeof(int));
+  label = (int *) malloc((n->a_intvalue + 1) * sizeof(int));
 
-  Ljumptop = genlabel();
   Lend = genlabel();
   // Set default label to Lend for now,
   // we will check later if a default
   // case is available.
   defaultlabel = Lend;
 
-  reg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, 0);
-  cgjump(Ljumptop);
-  genfreeregs(reg);
-
   for (i = 0, c = n->right; c != NULL; i++, c = c->right) {
-    caselabel[i] = genlabel();
-    caseval[i] = c->a_intvalue;
-    cglabel(caselabel[i]);
+    label[i] = genlabel();
     if (c->op == A_DEFAULT)
       // Update default label with the right label
-      defaultlabel = caselabel[i];
-    else
+      defaultlabel = label[i];
+    else {
+      caseval[casecount] = c->a_intvalue;
+      caselabel[casecount] = label[i];
       casecount++;
+    }
+  }
 
+  reg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, 0);
+  gencasedispatch(reg, caseval, caselabel, casecount, defaultlabel);
+
+  for (i = 0, c = n->right; c != NULL; i++, c = c->right) {
+    cglabel(label[i]);
     // Passing in the end label to allow breaks
     if (c->left)
       genAST(c->left, NOLABEL, NOLABEL, Lend, 0);
-    genfreeregs(NOREG);
   }
 
-  // Include a jump to the end of the switch after the last
-  // branch.
-  cgjump(Lend);
-
-  cgswitch(reg, casecount, Ljumptop, caselabel, caseval, defaultlabel);
-
   cglabel(Lend);
+  free(caseval);
+  free(caselabel);
+  free(label);
 
   return NOREG;
 }
 
+// Divide leftreg by rightreg for the A_DIVIDE or A_MOD op.
+// Division by a constant avoids idivq if it can, and then
+// the load of the constant into rightreg goes unused.
+static int gen_divmod(struct ASTnode *divisor, int leftreg, int rightreg,
+                      int op, int type) {
+  int reg;
+
+  if (divisor->op == A_INTLIT) {
+    reg = cgdivconst(leftreg, divisor->a_intvalue, op, type);
+    if (reg != NOREG)
+      return reg;
+  }
+  return cgdivmod(leftreg, rightreg, op);
+}
+
+// Return the number of nodes in the tree if it is cheap to
+// work out and can neither fail nor change anything, else -1
+static int cheapsize(struct ASTnode *n) {
+  int l, r;
+
+  if (n == NULL)
+    return 0;
+  switch (n->op) {
+    case A_IDENT:
+      if (!n->rvalue || n->sym->stype != S_VARIABLE)
+        return -1;
+      break;
+    case A_INTLIT:
+    case A_STRLIT:
+    case A_ADDR:
+    case A_WIDEN:
+    case A_SCALE:
+    case A_ADD:
+    case A_SUBTRACT:
+    case A_MULTIPLY:
+    case A_AND:
+    case A_OR:
+    case A_XOR:
+    case A_LSHIFT:
+    case A_RSHIFT:
+    case A_NEGATE:
+    case A_INVERT:
+      break;
+    default:
+      return -1;
+  }
+
+  l = cheapsize(n->left);
+  r = cheapsize(n->right);
+  if (l < 0 || r < 0)
+    return -1;
+  return 1 + l + r;
+}
+
+// Return true if both sides of the ternary can be worked out
+// and one picked with a conditional move. Each side must be
+// small, and safe to work out when the condition says not to,
+// e.g. the p->x in p ? p->x : 0 isn't.
+static int selectable(struct ASTnode *n) {
+  int t, f;
+
+  if (n->left->op < A_EQ || n->left->op > A_GE)
+    return 0;
+  if (!inttype(n->type) && !ptrtype(n->type))
+    return 0;
+  t = cheapsize(n->mid);
+  f = cheapsize(n->right);
+  return (t > 0 && t <= 3 && f > 0 && f <= 3);
+}
+
+// Generate a ternary as a conditional move, so
+// that there is no branch to mispredict
+static int gen_select(struct ASTnode *n) {
+  struct ASTnode *cond = n->left;
+  int truereg, falsereg, leftreg, rightreg;
+
+  truereg = genAST(n->mid, NOLABEL, NOLABEL, NOLABEL, n->op);
+  falsereg = genAST(n->right, NOLABEL, NOLABEL, NOLABEL, n->op);
+  leftreg = genAST(cond->left, NOLABEL, NOLABEL, NOLABEL, cond->op);
+  rightreg = genAST(cond->right, NOLABEL, NOLABEL, NOLABEL, cond->op);
+  return cgcompare_and_select(cond->op, leftreg, rightreg, truereg,
+                              falsereg, cond->left->type);
+}
+
 static int gen_ternary(struct ASTnode *n) {
   int Lfalse, Lend;
   int reg, expreg;
 
+  if (selectable(n))
+    return gen_select(n);
+
   // Generate labels for the false expression
   // and the end of the overall expression.
   Lfalse = genlabel();
@@ -172,7 +548,7 @@ static int gen_ternary(struct ASTnode *n) {
 
   // Generate condition code followed by jump to
   // the false label
-  genAST(n->left, Lfalse, NOLABEL, NOLABEL, n->op);
+  gencond(n->left, Lfalse, 0);
 
   // Alloc register to store result of ternary expr
   reg = alloc_register();
@@ -181,7 +557,6 @@ static int gen_ternary(struct ASTnode *n) {
   expreg = genAST(n->mid, NOLABEL, NOLABEL, NOLABEL, n->op);
   // Move the expression result into the known register
   cgmove(expreg, reg);
-  cgfreereg(expreg);
   cgjump(Lend);
   cglabel(Lfalse);
 
@@ -189,47 +564,79 @@ static int gen_ternary(struct ASTnode *n) {
   expreg = genAST(n->right, NOLABEL, NOLABEL, NOLABEL, n->op);
   // Move expression result into the known register
   cgmove(expreg, reg);
-  // Do not free register containing result
-  cgfreereg(expreg);
   cglabel(Lend);
 
   return reg;
 }
 
+// Generate the 0 or 1 value of a && or || expression
 static int gen_logandor(struct ASTnode *n) {
   int Lfalse = genlabel();
   int Lend = genlabel();
-  int reg;
+  int reg = alloc_register();
 
-  // Generate code for the left expression, followed
-  // by a jump to the Lfalse label
-  reg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, 0);
-  cgboolean(reg, n->op, Lfalse);
-  genfreeregs(NOREG);
-
-  reg = genAST(n->right, NOLABEL, NOLABEL, NOLABEL, 0);
-  cgboolean(reg, n->op, Lfalse);
-  genfreeregs(reg);
-
-  // The code below executes when there are no jumps
-  if (n->op == A_LOGAND) {
-    // If we get here for LOGAND, it must means that
-    // both expressions are true.
-    cgloadboolean(reg, 1);
-    cgjump(Lend);
-    cglabel(Lfalse);
-    cgloadboolean(reg, 0);
-  } else {
-    cgloadboolean(reg, 0);
-    cgjump(Lend);
-    cglabel(Lfalse);
-    // For logand, we set to true after jumping
-    cgloadboolean(reg, 1);
-  }
+  gencond(n, Lfalse, 0);
+  cgloadboolean(reg, 1);
+  cgjump(Lend);
+  cglabel(Lfalse);
+  cgloadboolean(reg, 0);
   cglabel(Lend);
   return reg;
 }
 
+// Return true if the tree is an index scaled by 2, 4 or 8
+static int isscaled(struct ASTnode *n) {
+  if (n->op != A_SCALE)
+    return 0;
+  return (n->a_size == 2 || n->a_size == 4 || n->a_size == 8);
+}
+
+// Pointer arithmetic. A pointer plus a constant, e.g. the
+// offset of a struct member, or plus an index scaled by 1, 2,
+// 4 or 8, is worked out with one leaq, which can then become
+// the memory operand of a load or store through the pointer.
+// Return NOREG if the tree isn't one of these.
+static int gen_ptradd(struct ASTnode *n) {
+  struct ASTnode *ptr = n->left;
+  struct ASTnode *idx = n->right;
+  int base, scale = 1;
+
+  // A scaled index has the pointer's type
+  if (ptr->op == A_SCALE || !ptrtype(ptr->type)) {
+    ptr = n->right;
+    idx = n->left;
+  }
+  if (!ptrtype(ptr->type))
+    return NOREG;
+
+  if (idx->op == A_INTLIT) {
+    base = genAST(ptr, NOLABEL, NOLABEL, NOLABEL, n->op);
+    return cglea(base, NOREG, 1, idx->a_intvalue);
+  }
+
+  if (isscaled(idx)) {
+    scale = idx->a_size;
+    idx = idx->left;
+  } else if (!inttype(idx->type))
+    return NOREG;
+
+  base = genAST(ptr, NOLABEL, NOLABEL, NOLABEL, n->op);
+  return cglea(base, genAST(idx, NOLABEL, NOLABEL, NOLABEL, n->op), scale, 0);
+}
+
+// Mark the variables whose address is taken in a function's
+// body. The scalar locals and params which aren't marked can
+// be kept in registers.
+static void findaddrtaken(struct ASTnode *n) {
+  if (n == NULL)
+    return;
+  if (n->op == A_ADDR && n->sym != NULL)
+    n->sym->st_addrtaken = 1;
+  findaddrtaken(n->left);
+  findaddrtaken(n->mid);
+  findaddrtaken(n->right);
+}
+
 // Given an AST node, recursively generate assembly
 // code for it. Returns the identifier of the register
 // that contains the results of evaluating this node.
@@ -251,13 +658,18 @@ int genAST(struct ASTnode *n, int iflabel,
       return genWHILE(n);
     case A_GLUE:
       if (n->left != NULL) genAST(n->left, iflabel, looptoplabel, loopendlabel, n->op);
-      genfreeregs(NOREG);
       if (n->right != NULL) genAST(n->right, iflabel, looptoplabel, loopendlabel, n->op);
-      genfreeregs(NOREG);
       return NOREG;
     case A_FUNCTION:
       // Generate the function preamble
+      findaddrtaken(n->left);
       cgfuncpreamble(n->sym);
+      Tailcalls = framesafe(n->sym);
+      Startlabel = NOLABEL;
+      if (hasselftail(n->left)) {
+        Startlabel = genlabel();
+        cglabel(Startlabel);
+      }
       genAST(n->left, NOREG, NOREG, NOREG, n->op);
       cgfuncpostamble(n->sym);
       return NOREG;
@@ -271,6 +683,18 @@ int genAST(struct ASTnode *n, int iflabel,
       return gen_logandor(n);
     case A_LOGAND:
       return gen_logandor(n);
+    case A_RETURN:
+      if (istailcall(n)) {
+        gen_tailcall(n);
+        return NOREG;
+      }
+      break;
+    case A_ADD:
+      if (ptrtype(n->type)) {
+        leftreg = gen_ptradd(n);
+        if (leftreg != NOREG)
+          return leftreg;
+      }
   }
 
   if (n->left) leftreg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
@@ -284,22 +708,18 @@ int genAST(struct ASTnode *n, int iflabel,
     case A_MULTIPLY:
       return cgmul(leftreg, rightreg);
     case A_DIVIDE:
-      return cgdivmod(leftreg, rightreg, A_DIVIDE);
+      return gen_divmod(n->right, leftreg, rightreg, A_DIVIDE, n->type);
     case A_MOD:
-      return (cgdivmod(leftreg, rightreg, A_MOD));
+      return gen_divmod(n->right, leftreg, rightreg, A_MOD, n->type);
     case A_EQ:
     case A_NE:
     case A_LT:
     case A_GT:
     case A_LE:
     case A_GE:
-      // If the parent node is an A_IF, generate a
-      // compare and jump, otherwise compare registers
-      // and set to either 0 or 1
-      if (parentASTop == A_IF || parentASTop == A_WHILE || parentASTop == A_TERNARY)
-        return cgcompare_and_jump(n->op, leftreg, rightreg, iflabel, n->left->type);
-      else
-        return cgcompare_and_set(n->op, leftreg, rightreg, n->left->type);
+      // Conditions are done by gencond(), so here
+      // we set a register to either 0 or 1
+      return cgcompare_and_set(n->op, leftreg, rightreg, n->left->type);
     case A_INTLIT:
       return cgloadint(n->a_intvalue, n->type);
     case A_IDENT:
@@ -334,11 +754,13 @@ int genAST(struct ASTnode *n, int iflabel,
           n->right = n->left;
           break;
         case A_ASSLASH:
-          leftreg = cgdivmod(leftreg, rightreg, A_DIVIDE);
+          leftreg = gen_divmod(n->right, leftreg, rightreg, A_DIVIDE,
+                               n->left->type);
           n->right = n->left;
           break;
         case A_ASMOD:
-          leftreg = cgdivmod(leftreg, rightreg, A_MOD);
+          leftreg = gen_divmod(n->right, leftreg, rightreg, A_MOD,
+                               n->left->type);
           n->right = n->left;
           break;
       }
@@ -406,7 +828,7 @@ int genAST(struct ASTnode *n, int iflabel,
     case A_LSHIFT:
       return cgshl(leftreg, rightreg);
     case A_RSHIFT:
-      return cgshr(leftreg, rightreg);
+      return cgshr(leftreg, rightreg, n->type);
     case A_POSTINC:
     case A_POSTDEC:
       return cgloadvar(n->sym, n->op);
@@ -420,7 +842,9 @@ int genAST(struct ASTnode *n, int iflabel,
     case A_LOGNOT:
       return cglognot(leftreg);
     case A_TOBOOL:
-      return cgboolean(leftreg, parentASTop, iflabel);
+      // Conditions are done by gencond(), so here
+      // we set a register to either 0 or 1
+      return cgboolean(leftreg, n->op, NOLABEL);
     case A_BREAK:
       cgjump(loopendlabel);
       return NOREG;
@@ -440,7 +864,6 @@ int genAST(struct ASTnode *n, int iflabel,
 
 void genpreamble()        { cgpreamble(); }
 void genpostamble()       { cgpostamble(); }
-void genfreeregs(int keepreg)        { freeall_registers(keepreg); }
 void genprintint(int reg) { cgprintint(reg); }
 
 void genglobsym(struct symtable *node) { cgglobsym(node); }
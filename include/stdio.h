@@ -11,6 +11,10 @@
 # define EOF (-1)
 #endif
 
+#ifndef SEEK_SET
+# define SEEK_SET 0
+#endif
+
 // This FILE definition will do for now
 typedef char * FILE;
 
@@ -18,6 +22,9 @@ FILE *fopen(char *pathname, char *mode);
 size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
 size_t fwrite(void *ptr, size_t size, size_t nmemb, FILE *stream);
 int fclose(FILE *stream);
+FILE *tmpfile(void);
+long ftell(FILE *stream);
+int fseek(FILE *stream, long offset, int whence);
 int printf(char *format);
 int fprintf(FILE *stream, char *format);
 int sprintf(char *str, char *format);
@@ -30,6 +37,7 @@ int putchar(int c);
 int puts(char *s);
 FILE *popen(char *command, char *type);
 int pclose(FILE *stream);
+int fflush(FILE *stream);
 
 extern FILE *stdin;
 extern FILE *stdout;
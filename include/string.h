@@ -9,5 +9,8 @@ char *strrchr(char *s, int c);
 int strcmp(char *s1, char *s2);
 int strncmp(char *s1, char *s2, size_t n);
 char *strerror(int errnum);
+char *strcpy(char *dst, char *src);
+size_t strlen(char *s);
+void *memset(void *s, int c, size_t n);
 
 #endif	// _STRING_H_
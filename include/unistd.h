@@ -3,5 +3,6 @@
 
 void _exit(int status);
 int unlink(char *pathname);
+int fork(void);
 
 #endif	// _UNISTD_H_
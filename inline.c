@@ -0,0 +1,264 @@
+// Function inlining
+//
+// A function whose body is just
+//
+//   return expression;
+//
+// with a small expression can take the place of the calls to it
+// which come after its definition. This saves the whole call
+// sequence: the arguments copied to registers, the registers
+// spilled around the call, the frame and the return. We keep a
+// copy of the expression for each such function, and each call
+// becomes a fresh copy with the arguments put in place of the
+// parameters, e.g. with
+//
+//   static int area(struct box *b) { return b->w * b->h; }
+//
+// area(&r) + 1 becomes (&r)->w * (&r)->h + 1, which is then
+// folded and optimised along with the rest of the caller.
+//
+// A call works out its arguments once, before the body runs.
+// So an argument must be pure, and one which the body uses more
+// than once must be cheap to work out again. If the body can
+// change memory, e.g. by calling another function, the arguments
+// must also be constants or variables that only the caller can
+// change.
+//
+// Only calls made once the caller has been parsed are replaced,
+// and a kept body already has its own calls replaced, so a
+// function can never be put into itself.
+
+#include "data.h"
+#include "arena.h"
+#include "inline.h"
+#include "misc.h"
+#include "opt.h"
+#include "tree.h"
+#include "types.h"
+
+static struct inlinefunc *Inlinehead;   // The functions we can inline
+static int Ninlined;                    // Calls replaced in this file
+
+// Return the kept body of the function, or NULL
+static struct ASTnode *inlinebody(struct symtable *sym) {
+  struct inlinefunc *f;
+
+  for (f = Inlinehead; f != NULL; f = f->next)
+    if (f->sym == sym)
+      return f->body;
+  return NULL;
+}
+
+// Return the number of nodes in the tree, or -1 if it uses
+// a local variable, or a parameter other than for its value
+static int inlinesize(struct ASTnode *n) {
+  int l, m, r;
+
+  if (n == NULL)
+    return 0;
+  if (n->sym != NULL && n->op != A_FUNCCALL) {
+    if (n->sym->class == C_LOCAL)
+      return -1;
+    if (n->sym->class == C_PARAM && (n->op != A_IDENT || !n->rvalue))
+      return -1;
+  }
+
+  l = inlinesize(n->left);
+  m = inlinesize(n->mid);
+  r = inlinesize(n->right);
+  if (l < 0 || m < 0 || r < 0)
+    return -1;
+  return 1 + l + m + r;
+}
+
+// Copy a tree into the global arena, so
+// that it outlives its function
+static struct ASTnode *keeptree(struct ASTnode *n) {
+  struct ASTnode *c;
+
+  if (n == NULL)
+    return NULL;
+  c = (struct ASTnode *) arenaalloc(Globarena, sizeof(struct ASTnode));
+  c->op = n->op;
+  c->type = n->type;
+  c->ctype = n->ctype;
+  c->rvalue = n->rvalue;
+  c->left = keeptree(n->left);
+  c->mid = keeptree(n->mid);
+  c->right = keeptree(n->right);
+  c->sym = n->sym;
+  c->a_intvalue = n->a_intvalue;
+  return c;
+}
+
+void keepinline(struct ASTnode *n) {
+  struct ASTnode *body = n->left;
+  struct inlinefunc *f;
+  int size;
+
+  if (O_inlinelimit <= 0 || n->type == P_VOID)
+    return;
+  if (body == NULL || body->op != A_RETURN)
+    return;
+  size = inlinesize(body->left);
+  if (size < 0 || size > O_inlinelimit)
+    return;
+
+  f = (struct inlinefunc *) arenaalloc(Globarena, sizeof(struct inlinefunc));
+  f->sym = n->sym;
+  f->body = keeptree(body->left);
+  f->next = Inlinehead;
+  Inlinehead = f;
+}
+
+void clearinline(void) {
+  Inlinehead = NULL;
+}
+
+// Return the number of times the tree reads the parameter
+static int paramuses(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL)
+    return 0;
+  if (n->op == A_IDENT && n->sym == sym)
+    return 1;
+  return paramuses(n->left, sym) + paramuses(n->mid, sym) +
+         paramuses(n->right, sym);
+}
+
+// Return the position of the parameter in the function's list
+static int paramno(struct symtable *func, struct symtable *sym) {
+  struct symtable *p;
+  int k = 0;
+
+  for (p = func->member; p != NULL; p = p->next) {
+    if (p == sym)
+      return k;
+    k++;
+  }
+  fatals("Unknown parameter in inlined function", func->name);
+  return -1;
+}
+
+// Return true if the tree takes the address of the symbol
+static int addrused(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL)
+    return 0;
+  if (n->op == A_ADDR && n->sym == sym)
+    return 1;
+  return (addrused(n->left, sym) || addrused(n->mid, sym) ||
+          addrused(n->right, sym));
+}
+
+// Return true if the argument costs no more to
+// work out each time the body uses it
+static int cheaparg(struct ASTnode *a) {
+  if (a->op == A_WIDEN)
+    a = a->left;
+  if (a->op == A_INTLIT || a->op == A_ADDR)
+    return 1;
+  return (a->op == A_IDENT && a->rvalue);
+}
+
+// Return true if the argument's value can't be changed by
+// anything the body does: a constant or an address, or a
+// local variable of the caller whose address isn't taken
+static int stablearg(struct ASTnode *a, struct ASTnode *func) {
+  if (a->op == A_WIDEN)
+    a = a->left;
+  if (a->op == A_INTLIT || a->op == A_ADDR)
+    return 1;
+  if (a->op != A_IDENT || !a->rvalue || a->sym->stype != S_VARIABLE)
+    return 0;
+  if (a->sym->class != C_LOCAL && a->sym->class != C_PARAM)
+    return 0;
+  return (!addrused(func, a->sym));
+}
+
+// Make a copy of the kept body with the arguments
+// in place of the function's parameters
+static struct ASTnode *instantiate(struct ASTnode *n, struct symtable *func,
+                                   struct ASTnode **args) {
+  struct ASTnode *c;
+
+  if (n == NULL)
+    return NULL;
+  if (n->op == A_IDENT && n->sym->class == C_PARAM)
+    return copytree(args[paramno(func, n->sym)]);
+
+  c = mkastnode(n->op, n->type, n->ctype, instantiate(n->left, func, args),
+                instantiate(n->mid, func, args),
+                instantiate(n->right, func, args), n->sym, n->a_intvalue);
+  c->rvalue = n->rvalue;
+  return c;
+}
+
+// Replace the call n in function func by the body of the
+// function called, if it has one and the arguments allow it
+static struct ASTnode *inlinecall(struct ASTnode *n, struct ASTnode *func) {
+  struct symtable *callee = n->sym;
+  struct ASTnode *body;
+  struct ASTnode **args;
+  struct ASTnode *glue, *a;
+  struct symtable *p;
+  int k, changes;
+
+  body = inlinebody(callee);
+  if (body == NULL)
+    return n;
+
+  // The arguments are glued together with the last one on top
+  args = (struct ASTnode **) arenaalloc(Funcarena,
+                         (callee->nelems + 1) * sizeof(struct ASTnode *));
+  k = callee->nelems;
+  for (glue = n->left; glue != NULL; glue = glue->left) {
+    if (k == 0)
+      return n;
+    k--;
+    args[k] = glue->right;
+  }
+  if (k != 0)
+    return n;
+
+  changes = !pure(body);
+  k = 0;
+  for (p = callee->member; p != NULL; p = p->next) {
+    a = args[k];
+    if (a->type == P_STRUCT || a->type == P_UNION)
+      return n;
+    a = modify_type(a, p->type, p->ctype, 0);
+    if (a == NULL || !pure(a))
+      return n;
+    if (paramuses(body, p) > 1 && !cheaparg(a))
+      return n;
+    if (changes && !stablearg(a, func))
+      return n;
+    args[k] = a;
+    k++;
+  }
+
+  Ninlined++;
+  return instantiate(body, callee, args);
+}
+
+// Replace the calls in the tree n of function func
+static struct ASTnode *inlinewalk(struct ASTnode *n, struct ASTnode *func) {
+  if (n == NULL)
+    return NULL;
+
+  n->left = inlinewalk(n->left, func);
+  n->mid = inlinewalk(n->mid, func);
+  n->right = inlinewalk(n->right, func);
+  if (n->op == A_FUNCCALL)
+    return inlinecall(n, func);
+  return n;
+}
+
+void inlinecalls(struct ASTnode *n) {
+  if (Inlinehead != NULL)
+    n->left = inlinewalk(n->left, n);
+}
+
+void inlinereport(void) {
+  printf("  inlining: %d calls replaced\n", Ninlined);
+  Ninlined = 0;
+}
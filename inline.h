@@ -0,0 +1,10 @@
+// Replace the calls in a function's tree by the
+// bodies of the small functions defined before it
+void inlinecalls(struct ASTnode *n);
+// Keep the body of a function if its calls can be
+// replaced by it
+void keepinline(struct ASTnode *n);
+// Forget the functions kept from the last input file
+void clearinline(void);
+// Print and reset the count of calls replaced
+void inlinereport(void);
@@ -0,0 +1,735 @@
+// Loop optimisations on a function's AST tree
+//
+// A for loop is parsed into
+//
+//   A_GLUE(preop, A_WHILE(cond, A_GLUE(body, postop)))
+//
+// and a while loop which starts with an assignment and
+// ends with an increment has the same shape.
+//
+// Induction variables: when the loop counter is only used
+// to index arrays and pointers which don't change in the loop,
+// e.g.
+//
+//   for (i = 0; i < n; i++) sum = sum + a[i];
+//
+// each address a + i * 4 is kept in a pointer of its own which
+// steps by 4 as i steps by 1, and the test on i becomes a test
+// on the pointer. If i isn't needed after the loop, it goes:
+//
+//   p = a; end = a + n * 4;
+//   while (p < end) { sum = sum + *p; ++p; }
+//
+// We leave the counter alone when it has other uses: a scaled
+// index costs nothing in an x86-64 address, so stepping a
+// pointer as well would only tie up another register.
+//
+// Loop-invariant code motion: an expression in a loop whose
+// value can't change while the loop runs, e.g. n * stride or a
+// load through a pointer when nothing in the loop stores to
+// memory, is worked out once before the loop into a variable
+// of its own. A load or a division might fault, so we only move
+// one that the loop would have done anyway: in the condition,
+// or in the body ahead of anything which might leave the loop
+// or skip it. One from the body is done under an if with a
+// copy of the condition, in case the loop doesn't run at all:
+//
+//   while (i < n) { s = s + p->x; i++; }
+//
+// becomes
+//
+//   if (i < n) t = p->x;
+//   while (i < n) { s = s + t; i++; }
+
+#include "data.h"
+#include "loop.h"
+#include "opt.h"
+#include "sym.h"
+#include "tree.h"
+#include "types.h"
+
+#define MAXIVPTRS 4       // Most pointers made for one loop
+
+static struct ASTnode *Funcbody;          // The function's statements
+static struct symtable *Ivsym;            // The loop counter
+static struct ASTnode *Ivbase[MAXIVPTRS]; // The array or pointer indexed
+static int Ivscale[MAXIVPTRS];            // The size of its elements
+static int Ivtype[MAXIVPTRS];             // The type of the address
+static struct symtable *Ivctype[MAXIVPTRS];
+static struct symtable *Ivptr[MAXIVPTRS]; // The pointer which replaces it
+static int Nivptrs;
+
+static struct ASTnode *Loop;          // The A_WHILE we are moving code out of
+static int Memfixed;                  // True if memory doesn't change in Loop
+static struct ASTnode *Pre;           // Assignments to do before Loop
+static struct ASTnode *Guarded;       // Ones to do if Loop runs at all
+
+// Counts for the verbose output
+static int Nivloops;                  // Loop counters replaced
+static int Nhoisted;                  // Expressions moved out of loops
+
+// Return true if the node names the symbol
+static int names(struct ASTnode *n, struct symtable *sym) {
+  if (n->sym != sym)
+    return 0;
+  switch (n->op) {
+    case A_IDENT:
+    case A_ADDR:
+    case A_POSTINC:
+    case A_POSTDEC:
+      return 1;
+  }
+  return 0;
+}
+
+// Count the references to a symbol in a tree
+static int refers(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL)
+    return 0;
+  return (names(n, sym) + refers(n->left, sym) + refers(n->mid, sym) +
+          refers(n->right, sym));
+}
+
+// Return true if the tree takes the address of the symbol
+static int addrof(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL)
+    return 0;
+  if (n->op == A_ADDR && n->sym == sym)
+    return 1;
+  return (addrof(n->left, sym) || addrof(n->mid, sym) ||
+          addrof(n->right, sym));
+}
+
+// Return true if the node is the variable sym
+static int isvar(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL || n->op != A_IDENT || n->sym != sym)
+    return 0;
+  return 1;
+}
+
+// Return true if the tree may change the variable
+static int changes(struct ASTnode *n, struct symtable *sym) {
+  if (n == NULL)
+    return 0;
+  switch (n->op) {
+    case A_ASSIGN:
+      if (isvar(n->right, sym))
+        return 1;
+      break;
+    case A_ASPLUS:
+    case A_ASMINUS:
+    case A_ASSTAR:
+    case A_ASSLASH:
+    case A_ASMOD:
+    case A_PREINC:
+    case A_PREDEC:
+      if (isvar(n->left, sym))
+        return 1;
+      break;
+    case A_POSTINC:
+    case A_POSTDEC:
+      if (n->sym == sym)
+        return 1;
+  }
+  return (changes(n->left, sym) || changes(n->mid, sym) ||
+          changes(n->right, sym));
+}
+
+// Return true if the symbol is a local variable or parameter
+// which can only change where the function assigns to it
+static int localsym(struct symtable *sym) {
+  if (sym->stype != S_VARIABLE)
+    return 0;
+  if (sym->class != C_LOCAL && sym->class != C_PARAM)
+    return 0;
+  return (!addrof(Funcbody, sym));
+}
+
+// Return true if the tree is such a variable
+static int localvar(struct ASTnode *n) {
+  if (n->op != A_IDENT)
+    return 0;
+  return localsym(n->sym);
+}
+
+// Return true if the tree has the same value
+// all the way through the loop
+static int invariant(struct ASTnode *n, struct ASTnode *loop) {
+  if (n->op == A_INTLIT)
+    return 1;
+  if (n->op == A_ADDR && n->sym != NULL)
+    return 1;
+  if (!localvar(n) || !n->rvalue)
+    return 0;
+  return (!changes(loop, n->sym));
+}
+
+// Return true if the tree is the loop counter, maybe widened
+// and scaled. Set *scale to the scale.
+static int ivindex(struct ASTnode *n, int *scale) {
+  *scale = 1;
+  if (n->op == A_SCALE) {
+    *scale = n->a_size;
+    n = n->left;
+  }
+  if (n->op == A_WIDEN)
+    n = n->left;
+  return (isvar(n, Ivsym) && n->rvalue);
+}
+
+// Return true if two trees are the same array or pointer
+static int samebase(struct ASTnode *a, struct ASTnode *b) {
+  if (a->op != b->op || a->sym != b->sym)
+    return 0;
+  return 1;
+}
+
+// If the tree is an address which steps with the loop counter,
+// base + i * scale, return the pointer that will hold it,
+// adding a new one if need be. Otherwise return -1.
+static int derived(struct ASTnode *n, struct ASTnode *loop) {
+  struct ASTnode *base = n->left;
+  struct ASTnode *index = n->right;
+  int k, scale;
+
+  if (n->op != A_ADD || !ptrtype(n->type))
+    return -1;
+  if (base->op == A_SCALE || !ptrtype(base->type)) {
+    base = n->right;
+    index = n->left;
+  }
+  if (base->op == A_INTLIT || !invariant(base, loop) ||
+      !ivindex(index, &scale))
+    return -1;
+
+  for (k = 0; k < Nivptrs; k++)
+    if (samebase(Ivbase[k], base) && Ivscale[k] == scale &&
+        Ivtype[k] == n->type)
+      return k;
+  if (Nivptrs == MAXIVPTRS)
+    return -1;
+
+  Ivbase[Nivptrs] = base;
+  Ivscale[Nivptrs] = scale;
+  Ivtype[Nivptrs] = n->type;
+  Ivctype[Nivptrs] = n->ctype;
+  Nivptrs++;
+  return Nivptrs - 1;
+}
+
+// Count the addresses in a tree which step with the loop counter
+static int countderived(struct ASTnode *n, struct ASTnode *loop) {
+  if (n == NULL)
+    return 0;
+  if (derived(n, loop) >= 0)
+    return 1;
+  return (countderived(n->left, loop) + countderived(n->mid, loop) +
+          countderived(n->right, loop));
+}
+
+// Make an A_IDENT node for a variable
+static struct ASTnode *mkvar(struct symtable *sym, int rvalue) {
+  struct ASTnode *n;
+
+  n = mkastleaf(A_IDENT, sym->type, sym->ctype, sym, 0);
+  n->rvalue = rvalue;
+  return n;
+}
+
+// Replace the addresses in a tree which step with
+// the loop counter by the pointers which hold them
+static struct ASTnode *reduce(struct ASTnode *n, struct ASTnode *loop) {
+  int k;
+
+  if (n == NULL)
+    return NULL;
+  k = derived(n, loop);
+  if (k >= 0)
+    return mkvar(Ivptr[k], 1);
+  n->left = reduce(n->left, loop);
+  n->mid = reduce(n->mid, loop);
+  n->right = reduce(n->right, loop);
+  return n;
+}
+
+// Build the address base + x * scale for pointer k
+static struct ASTnode *ivaddr(int k, struct ASTnode *x) {
+  struct symtable *ptr = Ivptr[k];
+  struct ASTnode *index;
+
+  if (x->op == A_INTLIT && x->a_intvalue == 0)
+    return copytree(Ivbase[k]);
+  if (x->op == A_INTLIT)
+    index = mkastleaf(A_INTLIT, P_LONG, NULL, NULL, x->a_intvalue * Ivscale[k]);
+  else {
+    index = copytree(x);
+    if (index->type != P_LONG)
+      index = mkastunary(A_WIDEN, P_LONG, NULL, index, NULL, 0);
+    if (Ivscale[k] > 1)
+      index = mkastunary(A_SCALE, ptr->type, ptr->ctype, index, NULL,
+                         Ivscale[k]);
+  }
+  index->rvalue = 1;
+  return mkastnode(A_ADD, ptr->type, ptr->ctype, copytree(Ivbase[k]), NULL,
+                   index, NULL, 0);
+}
+
+// Build sym = value
+static struct ASTnode *assign(struct symtable *sym, struct ASTnode *value) {
+  value->rvalue = 1;
+  return mkastnode(A_ASSIGN, sym->type, sym->ctype, value, NULL,
+                   mkvar(sym, 0), NULL, 0);
+}
+
+// Glue two trees together
+static struct ASTnode *glue(struct ASTnode *a, struct ASTnode *b) {
+  if (a == NULL)
+    return b;
+  return mkastnode(A_GLUE, P_NONE, NULL, a, NULL, b, NULL, 0);
+}
+
+// Build the tree which steps pointer k on
+// by step times the size of its elements
+static struct ASTnode *ivstepptr(int k, int step) {
+  struct symtable *ptr = Ivptr[k];
+  struct ASTnode *n;
+
+  if (step == 1)
+    return mkastunary(A_PREINC, ptr->type, ptr->ctype, mkvar(ptr, 0), NULL, 0);
+  if (step == -1)
+    return mkastunary(A_PREDEC, ptr->type, ptr->ctype, mkvar(ptr, 0), NULL, 0);
+  n = mkastleaf(A_INTLIT, P_LONG, NULL, NULL, step * Ivscale[k]);
+  n->rvalue = 1;
+  return mkastnode(A_ASPLUS, ptr->type, ptr->ctype, mkvar(ptr, 1), NULL,
+                   n, NULL, 0);
+}
+
+// If the tree adds a constant to a local int or long,
+// set Ivsym to the variable and return the constant.
+// Otherwise return 0.
+static int ivstep(struct ASTnode *n) {
+  struct ASTnode *var = NULL;
+  int step = 0;
+
+  switch (n->op) {
+    case A_POSTINC:
+    case A_POSTDEC:
+      var = mkvar(n->sym, 1);
+      step = (n->op == A_POSTINC) ? 1 : -1;
+      break;
+    case A_PREINC:
+    case A_PREDEC:
+      var = n->left;
+      step = (n->op == A_PREINC) ? 1 : -1;
+      break;
+    case A_ASPLUS:
+    case A_ASMINUS:
+      if (n->right->op != A_INTLIT)
+        return 0;
+      var = n->left;
+      step = n->right->a_intvalue;
+      if (n->op == A_ASMINUS)
+        step = -step;
+      break;
+    case A_ASSIGN:
+      // i = i + 5
+      if (n->left->op != A_ADD || n->left->right->op != A_INTLIT ||
+          n->right->op != A_IDENT || !isvar(n->left->left, n->right->sym))
+        return 0;
+      var = n->right;
+      step = n->left->right->a_intvalue;
+      break;
+    default:
+      return 0;
+  }
+
+  if (var->op != A_IDENT || !localvar(var))
+    return 0;
+  if (var->type != P_INT && var->type != P_LONG)
+    return 0;
+  Ivsym = var->sym;
+  return step;
+}
+
+// The pre and post operations of a for loop are lists
+// of expressions. Return the expression if there is
+// only one, else the list.
+static struct ASTnode *single(struct ASTnode *n) {
+  if (n != NULL && n->op == A_GLUE && n->left == NULL)
+    return n->right;
+  return n;
+}
+
+// Given A_GLUE(before, A_WHILE), return the statement or for
+// loop pre operation which comes just before the loop
+static struct ASTnode *initstmt(struct ASTnode *n) {
+  n = n->left;
+  if (n->op == A_GLUE)
+    return n->right;
+  return n;
+}
+
+// Return true if the tree is a loop which sets the
+// variable just before it starts
+static int setsfirst(struct ASTnode *n, struct symtable *sym) {
+  if (n->op != A_GLUE || n->left == NULL || n->right == NULL ||
+      n->right->op != A_WHILE)
+    return 0;
+  n = initstmt(n);
+  if (n == NULL || n->op != A_ASSIGN || !isvar(n->right, sym))
+    return 0;
+  return (refers(n->left, sym) == 0);
+}
+
+// Return true if the tree contains node m
+static int contains(struct ASTnode *n, struct ASTnode *m) {
+  if (n == NULL)
+    return 0;
+  if (n == m)
+    return 1;
+  return (contains(n->left, m) || contains(n->mid, m) ||
+          contains(n->right, m));
+}
+
+// Count the references to the loop counter outside the loop
+// which may read the value it leaves. A later loop which
+// sets the counter before it reads it doesn't.
+static int liverefs(struct ASTnode *n, struct ASTnode *loop) {
+  if (n == NULL)
+    return 0;
+  if (n == loop || (setsfirst(n, Ivsym) && !contains(n->right, loop))) {
+    // Only the statements before the loop's assignment count
+    if (n->left->op == A_GLUE)
+      return liverefs(n->left->left, loop);
+    return 0;
+  }
+  return (names(n, Ivsym) + liverefs(n->left, loop) +
+          liverefs(n->mid, loop) + liverefs(n->right, loop));
+}
+
+// Try to replace the counter of the loop n by pointers
+static void ivloop(struct ASTnode *n) {
+  struct ASTnode *init, *cond, *body, *limit, *loop;
+  struct ASTnode *pre = NULL, *post = NULL;
+  struct symtable *end;
+  int step, k, ivleft;
+
+  loop = n->right;
+  if (loop->right == NULL || loop->right->op != A_GLUE ||
+      loop->right->right == NULL)
+    return;
+
+  // The counter steps by a constant at the end of each
+  // time round the loop, and starts at a value which we
+  // can work out more than once
+  step = ivstep(single(loop->right->right));
+  if (step == 0 || !setsfirst(n, Ivsym))
+    return;
+  init = initstmt(n);
+  init = init->left;
+  if (!pure(init))
+    return;
+
+  // The loop runs while the counter compares with a
+  // value which doesn't change
+  cond = loop->left;
+  if (cond->op < A_EQ || cond->op > A_GE || refers(cond, Ivsym) != 1)
+    return;
+  ivleft = isvar(cond->left, Ivsym);
+  limit = ivleft ? cond->right : cond->left;
+  if (!ivleft && !isvar(cond->right, Ivsym))
+    return;
+  if (limit->op != A_INTLIT && limit->type != Ivsym->type)
+    return;
+  if (!invariant(limit, loop))
+    return;
+
+  // Every use of the counter in the body is an address,
+  // and the value it is left with isn't needed
+  body = loop->right->left;
+  Nivptrs = 0;
+  k = countderived(body, loop);
+  if (k == 0 || k != refers(body, Ivsym) || liverefs(Funcbody, n) != 0)
+    return;
+
+  for (k = 0; k < Nivptrs; k++)
+    Ivptr[k] = addlocl(NULL, Ivtype[k], Ivctype[k], S_VARIABLE, 1);
+  body = reduce(body, loop);
+  for (k = 0; k < Nivptrs; k++) {
+    pre = glue(pre, assign(Ivptr[k], ivaddr(k, init)));
+    post = glue(post, ivstepptr(k, step));
+  }
+  end = addlocl(NULL, Ivtype[0], Ivctype[0], S_VARIABLE, 1);
+  pre = glue(pre, assign(end, ivaddr(0, limit)));
+
+  // The loop's assignment to the counter becomes the
+  // assignments to the pointers
+  if (n->left->op == A_GLUE)
+    n->left->right = pre;
+  else
+    n->left = pre;
+  if (ivleft)
+    loop->left = mkastnode(cond->op, cond->type, NULL, mkvar(Ivptr[0], 1),
+                           NULL, mkvar(end, 1), NULL, 0);
+  else
+    loop->left = mkastnode(cond->op, cond->type, NULL, mkvar(end, 1),
+                           NULL, mkvar(Ivptr[0], 1), NULL, 0);
+  loop->right->left = body;
+  loop->right->right = post;
+  Nivloops++;
+}
+
+// Return true if the tree contains a node with the given op
+static int hasop(struct ASTnode *n, int op) {
+  if (n == NULL)
+    return 0;
+  if (n->op == op)
+    return 1;
+  return (hasop(n->left, op) || hasop(n->mid, op) || hasop(n->right, op));
+}
+
+// Return true if the tree can change memory other than
+// the local variables which live in registers
+static int stores(struct ASTnode *n) {
+  struct ASTnode *var = NULL;
+
+  if (n == NULL)
+    return 0;
+  switch (n->op) {
+    case A_FUNCCALL:
+      return 1;
+    case A_ASSIGN:
+      var = n->right;
+      break;
+    case A_ASPLUS:
+    case A_ASMINUS:
+    case A_ASSTAR:
+    case A_ASSLASH:
+    case A_ASMOD:
+    case A_PREINC:
+    case A_PREDEC:
+      var = n->left;
+      break;
+    case A_POSTINC:
+    case A_POSTDEC:
+      if (!localsym(n->sym))
+        return 1;
+  }
+  if (var != NULL && !localvar(var))
+    return 1;
+  return (stores(n->left) || stores(n->mid) || stores(n->right));
+}
+
+// Return true if the tree's value doesn't change in the loop
+static int fixed(struct ASTnode *n) {
+  if (n == NULL)
+    return 1;
+  switch (n->op) {
+    case A_INTLIT:
+    case A_STRLIT:
+      return 1;
+    case A_IDENT:
+      if (changes(Loop, n->sym))
+        return 0;
+      // A global or a variable in memory may change through
+      // a pointer, or in a function that the loop calls
+      return (Memfixed || localvar(n));
+    case A_ADDR:
+      if (n->sym != NULL)
+        return 1;
+      return fixed(n->left);
+    case A_DEREF:
+      if (!Memfixed || !n->rvalue)
+        return 0;
+      return fixed(n->left);
+    case A_ADD:
+    case A_SUBTRACT:
+    case A_MULTIPLY:
+    case A_DIVIDE:
+    case A_MOD:
+    case A_AND:
+    case A_OR:
+    case A_XOR:
+    case A_LSHIFT:
+    case A_RSHIFT:
+    case A_NEGATE:
+    case A_INVERT:
+    case A_WIDEN:
+    case A_SCALE:
+    case A_CAST:
+      return (fixed(n->left) && fixed(n->right));
+  }
+  return 0;
+}
+
+// Return true if working out the tree once before the
+// loop saves some work each time round it. Locals are in
+// registers, and the address of a variable, a string
+// literal or a scaled index can be part of the
+// instruction that uses it.
+static int worthmoving(struct ASTnode *n) {
+  switch (n->op) {
+    case A_INTLIT:
+    case A_STRLIT:
+      return 0;
+    case A_IDENT:
+      return (!localvar(n));
+    case A_ADDR:
+      if (n->sym == NULL)
+        return worthmoving(n->left);
+      return 0;
+    case A_WIDEN:
+    case A_SCALE:
+    case A_CAST:
+      return worthmoving(n->left);
+    case A_ADD:
+      if (ptrtype(n->type))
+        return (worthmoving(n->left) || worthmoving(n->right));
+  }
+  return 1;
+}
+
+// Return true if working out the tree might fault
+static int mayfault(struct ASTnode *n) {
+  return (hasop(n, A_DEREF) || hasop(n, A_DIVIDE) || hasop(n, A_MOD));
+}
+
+// Return true if the tree is a value which we can keep in a
+// variable. A widened or scaled value is left to be widened or
+// scaled in the loop, where it is usually free.
+static int movable(struct ASTnode *n) {
+  switch (n->op) {
+    case A_IDENT:
+    case A_DEREF:
+      if (!n->rvalue)
+        return 0;
+      break;
+    case A_WIDEN:
+    case A_SCALE:
+    case A_CAST:
+      return 0;
+  }
+  return (inttype(n->type) || ptrtype(n->type));
+}
+
+// The ways an expression in the loop is reached
+#define MAYRUN   0   // It may not be worked out
+#define CONDRUN  1   // It is worked out each time the loop is reached
+#define BODYRUN  2   // It is worked out each time the loop runs
+
+// Move the loop-invariant expressions in a tree out of the loop.
+// Return the tree with them replaced by the variables which hold
+// them.
+static struct ASTnode *hoist(struct ASTnode *n, int how) {
+  struct symtable *var;
+  struct ASTnode *set;
+
+  if (n == NULL)
+    return NULL;
+
+  if (movable(n) && fixed(n) && worthmoving(n) &&
+      (how != MAYRUN || !mayfault(n))) {
+    var = addlocl(NULL, n->type, n->ctype, S_VARIABLE, 1);
+    set = assign(var, n);
+    if (how == BODYRUN && mayfault(n))
+      Guarded = glue(Guarded, set);
+    else
+      Pre = glue(Pre, set);
+    Nhoisted++;
+    return mkvar(var, 1);
+  }
+
+  // Only the left of &&, || and ?: is always worked out
+  n->left = hoist(n->left, how);
+  if (n->op == A_LOGAND || n->op == A_LOGOR || n->op == A_TERNARY)
+    how = MAYRUN;
+  n->mid = hoist(n->mid, how);
+  n->right = hoist(n->right, how);
+  return n;
+}
+
+// Move the loop-invariant expressions out of the statements in
+// the loop's body. Set *stop once we reach a statement which
+// might leave the loop early or not be run.
+static struct ASTnode *hoiststmts(struct ASTnode *n, int *stop) {
+  if (n == NULL)
+    return NULL;
+  if (n->op == A_GLUE) {
+    n->left = hoiststmts(n->left, stop);
+    n->right = hoiststmts(n->right, stop);
+    return n;
+  }
+
+  switch (n->op) {
+    case A_IF:
+    case A_WHILE:
+    case A_SWITCH:
+    case A_RETURN:
+    case A_BREAK:
+    case A_CONTINUE:
+      *stop = 1;
+  }
+  if (hasop(n, A_FUNCCALL))
+    *stop = 1;
+  if (*stop)
+    return hoist(n, MAYRUN);
+  return hoist(n, BODYRUN);
+}
+
+// Move the loop-invariant expressions out of the loop n.
+// Return the tree to replace it with.
+static struct ASTnode *licm(struct ASTnode *n) {
+  int stop = 0;
+
+  Loop = n;
+  Memfixed = !stores(n);
+  Pre = Guarded = NULL;
+
+  // The condition is worked out an extra time to guard the
+  // code moved from the body, so it must have no side effects
+  if (!pure(n->left))
+    stop = 1;
+  n->left = hoist(n->left, CONDRUN);
+  n->right = hoiststmts(n->right, &stop);
+
+  if (Guarded != NULL)
+    Pre = glue(Pre, mkastnode(A_IF, P_NONE, NULL, copytree(n->left),
+                              Guarded, NULL, NULL, 0));
+  if (Pre == NULL)
+    return n;
+  return glue(Pre, n);
+}
+
+// Visit the loops innermost first. Return the tree
+// to replace n with.
+static struct ASTnode *walkloops(struct ASTnode *n) {
+  if (n == NULL)
+    return NULL;
+  n->left = walkloops(n->left);
+  n->mid = walkloops(n->mid);
+  n->right = walkloops(n->right);
+
+  // The code moved out of a loop goes in front of it,
+  // so the loop's parent does the moving
+  if (n->op == A_GLUE && n->left != NULL && n->right != NULL &&
+      n->right->op == A_WHILE)
+    ivloop(n);
+  if (n->left != NULL && n->left->op == A_WHILE)
+    n->left = licm(n->left);
+  if (n->mid != NULL && n->mid->op == A_WHILE)
+    n->mid = licm(n->mid);
+  if (n->right != NULL && n->right->op == A_WHILE)
+    n->right = licm(n->right);
+  return n;
+}
+
+void loopopt(struct ASTnode *n) {
+  Funcbody = n->left;
+  walkloops(n);
+}
+
+void loopreport(void) {
+  printf("  loops: %d counters replaced by pointers, %d expressions hoisted\n",
+         Nivloops, Nhoisted);
+  Nivloops = Nhoisted = 0;
+}
@@ -0,0 +1,6 @@
+// Replace loop counters which are only used to index
+// arrays by pointers which step through them, and move
+// loop-invariant expressions out of loops
+void loopopt(struct ASTnode *n);
+// Print and reset the counts of what loopopt() did
+void loopreport(void);
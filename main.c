@@ -1,9 +1,16 @@
 #include <errno.h>
 #include <unistd.h>
+#include <sys/wait.h>
 #include "data.h"
+#include "arena.h"
+#include "cpp.h"
 #include "decl.h"
 #include "expr.h"
 #include "gen.h"
+#include "inline.h"
+#include "loop.h"
+#include "peep.h"
+#include "reach.h"
 #include "scan.h"
 #include "stmt.h"
 #include "sym.h"
@@ -13,10 +20,11 @@
 
 int Line;
 int Putback;
-FILE *Infile;
 FILE *Outfile;
 char *Infilename;
 char *Outfilename;
+struct arena *Funcarena;
+struct arena *Globarena;
 
 int O_dumpAST;
 int O_keepasm;
@@ -24,23 +32,44 @@ int O_assemble;
 int O_dolink;
 int O_verbose;
 int O_dumpsym;
+int O_jobs;
+int O_peepstats;
+int O_omitfp;
+int O_inlinelimit;
 
 static void init() {
   Line = 1;
   Putback = '\n';
   O_dumpAST = 0;
+  Funcarena = newarena();
+  Globarena = newarena();
 }
 
 static void usage(char *prog) {
-  fprintf(stderr, "Usage: %s [-vcST] [-o outfile] file [file ...]\n", prog);
+  fprintf(stderr, "Usage: %s [-vcSTMP] [-j jobs] [-f feature] [-o outfile] file [file ...]\n", prog);
   fprintf(stderr, "       -v give verbose output of the compilation stages\n");
   fprintf(stderr, "       -c generate object files but don't link them\n");
   fprintf(stderr, "       -S generate assembly files but don't link them\n");
   fprintf(stderr, "       -T dump the AST trees for each input file\n");
+  fprintf(stderr, "       -M dump the symbol table and lookup counts for each input file\n");
+  fprintf(stderr, "       -P report what each peephole rule removed for each input file\n");
+  fprintf(stderr, "       -j jobs, compile up to this many files at once\n");
+  fprintf(stderr, "       -fomit-frame-pointer address locals from %%rsp, not %%rbp\n");
+  fprintf(stderr, "       -finline-limit=n inline functions of up to n tree nodes, 0 for none\n");
   fprintf(stderr, "       -o outfile, produce the outfile executable file\n");
   exit(1);
 }
 
+// Turn on a -f feature
+static void setfeature(char *name, char *prog) {
+  if (!strcmp(name, "omit-frame-pointer"))
+    O_omitfp = 1;
+  else if (!strncmp(name, "inline-limit=", 13))
+    O_inlinelimit = atoi(name + 13);
+  else
+    usage(prog);
+}
+
 static char *alter_suffix(char *str, char suffix) {
   char *posn;
   char *newstr;
@@ -68,19 +97,13 @@ static char *alter_suffix(char *str, char suffix) {
 // down to assembly code and return the resulting
 // file's name
 static char *do_compile(char *filename) {
-  char cmd[TEXTLEN];
-
   Outfilename = alter_suffix(filename, 's');
   if (Outfilename == NULL) {
     fprintf(stderr, "Error: %s has no suffix, try appending .c at the end the input filename.\n", filename);
     exit(1);
   }
 
-  // Preprocessor command
-  // INCDIR defined in Makefile
-  snprintf(cmd, TEXTLEN, "%s %s %s", CPPCMD, INCDIR, filename);
-
-  if ((Infile = popen(cmd, "r")) == NULL) {
+  if (ppopen(filename) == -1) {
     fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
     exit(1);
   }
@@ -92,9 +115,12 @@ static char *do_compile(char *filename) {
   }
 
   Line = 1;
-  Linestart = 1;
   Putback = '\n';
+  arenareset(Funcarena);
+  arenareset(Globarena);
   clear_symtable();
+  clearinline();
+  clearstatics();
 
   if (O_verbose)
     printf("compiling %s\n", filename);
@@ -102,9 +128,23 @@ static char *do_compile(char *filename) {
   scan(&Token);
   genpreamble();
   global_declarations();
+  writestatics();
   genpostamble();
   fclose(Outfile);
 
+  if (O_verbose) {
+    printf("  arena peak: %d bytes per function, %d bytes for globals\n",
+           Funcarena->peak, Globarena->inuse);
+    inlinereport();
+    loopreport();
+    staticreport();
+  }
+
+  if (O_peepstats) {
+    printf("Peephole rules for %s\n", filename);
+    peepreport();
+  }
+
   if (O_dumpsym) {
     printf("Symbols for %s\n", filename);
     dumpsymtables();
@@ -141,6 +181,74 @@ static char *do_assemble(char *filename) {
   return outfilename;
 }
 
+// Compile and, if required, assemble one input file.
+// Return the object file's name, or NULL if we are
+// not assembling.
+static char *do_file(char *filename) {
+  char *asmfile, *objfile = NULL;
+
+  asmfile = do_compile(filename);
+
+  if (O_dolink || O_assemble)
+    // Assemble to object form
+    objfile = do_assemble(asmfile);
+
+  // Remove the assembly file if we do not
+  // need to retain it
+  if (!O_keepasm)
+    unlink(asmfile);
+
+  return objfile;
+}
+
+// Compile the input files in worker processes, with up to
+// O_jobs of them running at once. Each worker gets its own
+// copy of the compiler's global state, and each file's
+// output only depends on the file, so the results don't
+// depend on the order in which the workers finish.
+static void do_parallel(char **files, int nfiles) {
+  int i, pid, status, running = 0, failed = 0;
+
+  for (i = 0; i < nfiles && !failed; i++) {
+    // Wait for a worker to finish if we have enough running
+    if (running == O_jobs) {
+      wait(&status);
+      running--;
+      if (status != 0)
+        failed = 1;
+    }
+
+    if (!failed) {
+      // Don't let the workers inherit our buffered output
+      fflush(stdout);
+      pid = fork();
+      if (pid < 0) {
+        fprintf(stderr, "Unable to start a worker for %s: %s\n",
+                files[i], strerror(errno));
+        exit(1);
+      }
+
+      if (pid == 0) {
+        do_file(files[i]);
+        exit(0);
+      }
+      running++;
+    }
+  }
+
+  // Wait for the rest of the workers
+  while (running > 0) {
+    wait(&status);
+    running--;
+    if (status != 0)
+      failed = 1;
+  }
+
+  // The workers have already reported any errors
+  if (failed)
+    exit(1);
+}
+
 void do_link(char *outfilename, char **objlist) {
   int cnt, size = TEXTLEN;
   char cmd[TEXTLEN], *cptr;
@@ -170,7 +278,7 @@ void do_link(char *outfilename, char **objlist) {
 
 int main(int argc, char** argv) {
   int i, j, objcount = 0;
-  char *asmfile, *objfile;
+  char *objfile;
   char *objlist[MAXOBJ];
   char *outfilename = AOUT;
 
@@ -180,6 +288,10 @@ int main(int argc, char** argv) {
   O_assemble = 0;       // If true, assemble the assembly files
   O_dolink = 1;         // If true, link the object files
   O_verbose = 0;        // If true, print info on compilation stages
+  O_jobs = 1;           // Number of files to compile at once
+  O_peepstats = 0;      // If true, report the peephole optimiser counts
+  O_omitfp = 0;         // If true, don't set up %rbp as a frame pointer
+  O_inlinelimit = 16;   // Largest function body we inline, zero for none
 
   init();
 
@@ -210,6 +322,19 @@ int main(int argc, char** argv) {
         case 'v':
           O_verbose = 1;
           break;
+        case 'P':
+          O_peepstats = 1;
+          break;
+        case 'j':
+          O_jobs = atoi(argv[++i]);
+          if (O_jobs < 1)
+            usage(argv[0]);
+          break;
+        case 'f':
+          // The rest of the argument names the feature
+          setfeature(argv[i] + j + 1, argv[0]);
+          j = (int) strlen(argv[i]) - 1;
+          break;
         default:
           usage(argv[0]);
       }
@@ -219,14 +344,21 @@ int main(int argc, char** argv) {
   // Ensure that we have an input file argument
   if (i >= argc) usage(argv[0]);
 
+  // Compile the input files in parallel if asked to
+  if (O_jobs > 1)
+    do_parallel(argv + i, argc - i);
+
   // Work on each input file
   while (i < argc) {
-    asmfile = do_compile(argv[i]);
-
-    if (O_dolink || O_assemble) {
-      // Assemble to object form
-      objfile = do_assemble(asmfile);
-
+    if (O_jobs > 1) {
+      // The workers have already made the object file
+      objfile = NULL;
+      if (O_dolink || O_assemble)
+        objfile = alter_suffix(alter_suffix(argv[i], 's'), 'o');
+    } else
+      objfile = do_file(argv[i]);
+
+    if (objfile != NULL) {
       if (objcount == (MAXOBJ - 2)) {
         fprintf(stderr, "Too many object files for the compiler to handle\n");
         exit(1);
@@ -237,11 +369,6 @@ int main(int argc, char** argv) {
       objlist[objcount] = NULL;
     }
 
-    // Remove the assembly file if we do not
-    // keep to retain it
-    if (!O_keepasm)
-      unlink(asmfile);
-
     i++;
   }
 
@@ -1,7 +1,76 @@
 #include "data.h"
+#include "inline.h"
+#include "loop.h"
 #include "opt.h"
 #include "tree.h"
 
+// Make an A_INTLIT leaf with the given type and value
+static struct ASTnode *mklit(int type, int val) {
+  return mkastleaf(A_INTLIT, type, NULL, NULL, val);
+}
+
+int pure(struct ASTnode *n) {
+  if (n == NULL)
+    return 1;
+
+  switch (n->op) {
+    case A_ASSIGN:
+    case A_ASPLUS:
+    case A_ASMINUS:
+    case A_ASSTAR:
+    case A_ASSLASH:
+    case A_ASMOD:
+    case A_FUNCCALL:
+    case A_PREINC:
+    case A_PREDEC:
+    case A_POSTINC:
+    case A_POSTDEC:
+      return 0;
+  }
+  return (pure(n->left) && pure(n->mid) && pure(n->right));
+}
+
+// Return true if the tree is cheap enough to evaluate more
+// than once, i.e. a variable which may have been widened
+static int simple(struct ASTnode *n) {
+  if (n->op == A_WIDEN)
+    n = n->left;
+  return (n->op == A_IDENT && n->rvalue);
+}
+
+// Return true if the tree's value can't be negative.
+// Our chars are unsigned.
+static int nonneg(struct ASTnode *n) {
+  if (n->op == A_WIDEN)
+    n = n->left;
+  return (n->type == P_CHAR);
+}
+
+struct ASTnode *copytree(struct ASTnode *n) {
+  struct ASTnode *c;
+
+  if (n == NULL)
+    return NULL;
+  c = mkastnode(n->op, n->type, n->ctype, copytree(n->left),
+                copytree(n->mid), copytree(n->right), n->sym, n->a_intvalue);
+  c->rvalue = n->rvalue;
+  return c;
+}
+
+// If val is 2 to the power k for some k >= 1, return k.
+// Otherwise, return -1.
+static int log2exact(int val) {
+  int k = 0;
+
+  if (val < 2 || (val & (val - 1)) != 0)
+    return -1;
+  while (val > 1) {
+    val = val >> 1;
+    k++;
+  }
+  return k;
+}
+
 // Fold an AST tree with a binary operator and
 // two A_INTLIT children. Return either the
 // original tree or a new leaf node.
@@ -22,16 +91,64 @@ static struct ASTnode *fold2(struct ASTnode *n) {
       val = leftval * rightval;
       break;
     case A_DIVIDE:
-      // Let the crash occur during execution
-      if (rightval == 0)
+    case A_MOD:
+      // Let the crash occur during execution, not
+      // here in the compiler. INT_MIN / -1 overflows
+      if (rightval == 0 || (rightval == -1 && leftval == -2147483647 - 1))
         return n;
-      val = leftval / rightval;
+      if (n->op == A_DIVIDE)
+        val = leftval / rightval;
+      else
+        val = leftval % rightval;
+      break;
+    case A_AND:
+      val = leftval & rightval;
+      break;
+    case A_OR:
+      val = leftval | rightval;
+      break;
+    case A_XOR:
+      val = leftval ^ rightval;
+      break;
+    case A_LSHIFT:
+    case A_RSHIFT:
+      // Leave shifts we can't do in an int for run time
+      if (rightval < 0 || rightval > 31)
+        return n;
+      if (n->op == A_LSHIFT)
+        val = leftval << rightval;
+      else
+        val = leftval >> rightval;
+      break;
+    case A_EQ:
+      val = (leftval == rightval);
+      break;
+    case A_NE:
+      val = (leftval != rightval);
+      break;
+    case A_LT:
+      val = (leftval < rightval);
+      break;
+    case A_GT:
+      val = (leftval > rightval);
+      break;
+    case A_LE:
+      val = (leftval <= rightval);
+      break;
+    case A_GE:
+      val = (leftval >= rightval);
+      break;
+    case A_LOGAND:
+      val = (leftval && rightval);
+      break;
+    case A_LOGOR:
+      val = (leftval || rightval);
       break;
     default:
       return n;
   }
 
-  return mkastleaf(A_INTLIT, n->type, NULL,NULL, val);
+  return mklit(n->type, val);
 }
 
 // Fold on AST tree with a unary operator and one
@@ -53,11 +170,222 @@ static struct ASTnode *fold1(struct ASTnode *n) {
     case A_LOGNOT:
       val = !val;
       break;
+    case A_NEGATE:
+      val = -val;
+      break;
+    case A_TOBOOL:
+      val = (val != 0);
+      break;
+    case A_SCALE:
+      val = val * n->a_size;
+      break;
+    case A_CAST:
+      // Our chars are unsigned
+      if (n->type == P_CHAR)
+        val = val & 0xff;
+      break;
+    default:
+      return n;
+  }
+
+  return mklit(n->type, val);
+}
+
+// Fold the constants in chains of additions, multiplications
+// and bitwise operations, e.g. (x + 1) + 2 becomes x + 3 and
+// (x * 2) * 4 becomes x * 8. The constant has already been
+// moved to the right of each operator. A sum or product which
+// doesn't fit in an int literal is left alone, as a long or
+// pointer expression would need all of its bits.
+static struct ASTnode *reassociate(struct ASTnode *n) {
+  struct ASTnode *l = n->left;
+  long big;
+  int val;
+
+  if (n->right->op != A_INTLIT || l->op != n->op ||
+      l->right->op != A_INTLIT)
+    return n;
+
+  val = n->right->a_intvalue;
+  big = l->right->a_intvalue;
+  switch (n->op) {
+    case A_ADD:
+    case A_MULTIPLY:
+      if (n->op == A_ADD)
+        big = big + val;
+      else
+        big = big * val;
+      if (big > 2147483647 || big < -2147483647 - 1)
+        return n;
+      val = (int) big;
+      break;
+    case A_AND:
+      val = l->right->a_intvalue & val;
+      break;
+    case A_OR:
+      val = l->right->a_intvalue | val;
+      break;
+    case A_XOR:
+      val = l->right->a_intvalue ^ val;
+      break;
     default:
       return n;
   }
 
-  return mkastleaf(A_INTLIT, n->type, NULL, NULL, val);
+  n->left = l->left;
+  n->right = mklit(n->right->type, val);
+  return n;
+}
+
+// Replace multiplication, division and modulo by a power
+// of two with shifts and masks. A negative number has to
+// be rounded towards zero, so for x / 8 we generate
+//   (x + ((x >> 63) & 7)) >> 3
+// and for x % 8
+//   x - ((x + ((x >> 63) & 7)) & -8)
+// where x >> 63 is all ones for a negative x, else zero.
+static struct ASTnode *strength(struct ASTnode *n) {
+  struct ASTnode *x = n->left;
+  struct ASTnode *bias;
+  int k, val;
+
+  val = n->right->a_intvalue;
+  k = log2exact(val);
+  if (k < 0)
+    return n;
+
+  if (n->op == A_MULTIPLY) {
+    n->op = A_LSHIFT;
+    n->right = mklit(n->right->type, k);
+    return n;
+  }
+
+  // We may evaluate x more than once
+  if (!pure(x) || !simple(x))
+    return n;
+
+  if (nonneg(x)) {
+    if (n->op == A_DIVIDE)
+      return mkastnode(A_RSHIFT, n->type, NULL, x, NULL,
+                       mklit(P_INT, k), NULL, 0);
+    return mkastnode(A_AND, n->type, NULL, x, NULL,
+                     mklit(P_INT, val - 1), NULL, 0);
+  }
+
+  bias = mkastnode(A_RSHIFT, n->type, NULL, copytree(x), NULL,
+                   mklit(P_INT, 63), NULL, 0);
+  bias = mkastnode(A_AND, n->type, NULL, bias, NULL,
+                   mklit(P_INT, val - 1), NULL, 0);
+  bias = mkastnode(A_ADD, n->type, NULL, copytree(x), NULL, bias, NULL, 0);
+  if (n->op == A_DIVIDE)
+    return mkastnode(A_RSHIFT, n->type, NULL, bias, NULL,
+                     mklit(P_INT, k), NULL, 0);
+  bias = mkastnode(A_AND, n->type, NULL, bias, NULL,
+                   mklit(P_INT, -val), NULL, 0);
+  return mkastnode(A_SUBTRACT, n->type, NULL, x, NULL, bias, NULL, 0);
+}
+
+// Simplify a binary operator with one A_INTLIT child
+static struct ASTnode *simplify2(struct ASTnode *n) {
+  struct ASTnode *tmp;
+  int val;
+
+  // Put the constant on the right of commutative operators
+  if (n->left->op == A_INTLIT) {
+    switch (n->op) {
+      case A_ADD:
+      case A_MULTIPLY:
+      case A_AND:
+      case A_OR:
+      case A_XOR:
+      case A_EQ:
+      case A_NE:
+        tmp = n->left;
+        n->left = n->right;
+        n->right = tmp;
+    }
+  }
+  if (n->right->op != A_INTLIT)
+    return n;
+  val = n->right->a_intvalue;
+
+  // x - 5 is x + -5, which can then be reassociated
+  if (n->op == A_SUBTRACT) {
+    n->op = A_ADD;
+    n->right = mklit(n->right->type, -val);
+    val = -val;
+  }
+
+  n = reassociate(n);
+  if (n->right->op != A_INTLIT)
+    return n;
+  val = n->right->a_intvalue;
+
+  // The identities x + 0, x * 1, x << 0 etc. These can't go
+  // when they change the type, e.g. the address of a struct
+  // plus the offset of its first member
+  if (n->left->type == n->type) {
+    switch (n->op) {
+      case A_ADD:
+      case A_OR:
+      case A_XOR:
+      case A_LSHIFT:
+      case A_RSHIFT:
+        if (val == 0)
+          return n->left;
+        break;
+      case A_MULTIPLY:
+      case A_DIVIDE:
+        if (val == 1)
+          return n->left;
+        break;
+    }
+  }
+
+  // x * 0 and x & 0 are zero, if we don't need to evaluate x
+  if ((n->op == A_MULTIPLY || n->op == A_AND) && val == 0 && pure(n->left))
+    return mklit(n->type, 0);
+
+  // x && 0 and x || 1 are constants, if we don't need to evaluate x.
+  // x && 1 and x || 0 are whether x is true.
+  if (n->op == A_LOGAND || n->op == A_LOGOR) {
+    if ((n->op == A_LOGAND) == (val != 0))
+      return mkastunary(A_TOBOOL, n->type, NULL, n->left, NULL, 0);
+    if (pure(n->left))
+      return mklit(n->type, val != 0);
+  }
+
+  if (n->op == A_MULTIPLY || n->op == A_DIVIDE || n->op == A_MOD)
+    return strength(n);
+  return n;
+}
+
+// Simplify a tree whose condition is an A_INTLIT
+static struct ASTnode *simplifycond(struct ASTnode *n) {
+  int val = n->left->a_intvalue;
+
+  switch (n->op) {
+    case A_LOGAND:
+    case A_LOGOR:
+      // 0 && x is 0 and 1 || x is 1, x isn't evaluated.
+      // 1 && x and 0 || x are whether x is true.
+      if ((n->op == A_LOGAND) == (val != 0))
+        return mkastunary(A_TOBOOL, n->type, NULL, n->right, NULL, 0);
+      return mklit(n->type, val != 0);
+    case A_TERNARY:
+      if (val != 0)
+        return n->mid;
+      return n->right;
+    case A_IF:
+      // The statements which can't be reached go
+      if (val != 0)
+        return n->mid;
+      return n->right;
+    case A_WHILE:
+      if (val == 0)
+        return NULL;
+  }
+  return n;
 }
 
 static struct ASTnode *fold(struct ASTnode *n) {
@@ -65,20 +393,90 @@ static struct ASTnode *fold(struct ASTnode *n) {
     return NULL;
 
   n->left = fold(n->left);
+  n->mid = fold(n->mid);
   n->right = fold(n->right);
 
+  // A condition which is a constant
+  if (n->left != NULL && n->left->op == A_INTLIT &&
+      (n->op == A_LOGAND || n->op == A_LOGOR || n->op == A_TERNARY ||
+       n->op == A_IF || n->op == A_WHILE))
+    return simplifycond(n);
+
   if (n->left && n->left->op == A_INTLIT) {
     if (n->right && n->right->op == A_INTLIT)
-      n = fold2(n);
-    else
-      n = fold1(n);
+      return fold2(n);
+    if (n->right == NULL && n->mid == NULL)
+      return fold1(n);
+  }
+
+  // A binary operator with one constant
+  if (n->left != NULL && n->right != NULL && n->mid == NULL &&
+      n->op >= A_LOGOR && n->op <= A_MOD &&
+      (n->left->op == A_INTLIT || n->right->op == A_INTLIT))
+    return simplify2(n);
+
+  return n;
+}
+
+// Return true if control never goes on from the
+// statement to the one which follows it
+static int endsflow(struct ASTnode *n) {
+  if (n == NULL)
+    return 0;
+  switch (n->op) {
+    case A_RETURN:
+    case A_BREAK:
+    case A_CONTINUE:
+      return 1;
+    case A_GLUE:
+      return (endsflow(n->left) || endsflow(n->right));
+    case A_IF:
+      return (endsflow(n->mid) && endsflow(n->right));
   }
+  return 0;
+}
+
+// Remove the statements which can't be reached because
+// they follow a return, break or continue. Statements are
+// glued together with the earlier ones on the left.
+static struct ASTnode *deadcode(struct ASTnode *n) {
+  struct ASTnode *c;
 
+  if (n == NULL)
+    return NULL;
+  switch (n->op) {
+    case A_GLUE:
+      n->left = deadcode(n->left);
+      if (endsflow(n->left))
+        return n->left;
+      n->right = deadcode(n->right);
+      break;
+    case A_IF:
+      n->mid = deadcode(n->mid);
+      n->right = deadcode(n->right);
+      break;
+    case A_WHILE:
+      n->right = deadcode(n->right);
+      break;
+    case A_SWITCH:
+      for (c = n->right; c != NULL; c = c->right)
+        c->left = deadcode(c->left);
+      break;
+    case A_FUNCTION:
+      n->left = deadcode(n->left);
+  }
   return n;
 }
 
 struct ASTnode *optimise(struct ASTnode *n) {
+  if (n != NULL && n->op == A_FUNCTION)
+    inlinecalls(n);
   n = fold(n);
+  if (n != NULL && n->op == A_FUNCTION) {
+    deadcode(n);
+    loopopt(n);
+    keepinline(n);
+  }
 
   return n;
 }
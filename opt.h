@@ -1 +1,8 @@
+// Return true if evaluating the tree has no side effects,
+// so it can be thrown away or evaluated more than once
+int pure(struct ASTnode *n);
+// Make a copy of a tree
+struct ASTnode *copytree(struct ASTnode *n);
+// Inline small functions, fold constants, simplify, remove
+// dead code and optimise the loops in a tree
 struct ASTnode *optimise(struct ASTnode *n);
@@ -0,0 +1,389 @@
+// Peephole optimiser
+//
+// Once the registers of a function have been allocated, we make
+// passes over its instruction list looking for short sequences
+// which can be removed or done more cheaply, until nothing more
+// changes. Most of these come from code generation working one
+// AST node at a time, and from the allocator's spill code:
+//
+//   movq %r10, %r10                     self move, removed
+//   movq %r10, -8(%rbp)                 a load of the value just
+//   movq -8(%rbp), %r11                 stored comes from the register
+//   movq %r10, %r11; movq %r11, %r10    move back, removed
+//   movq -8(%rbp), %r10                 a store of the value just
+//   movq %r10, -8(%rbp)                 loaded is removed
+//   jmp L5; L5:                         jump to next, removed
+//   jmp L5; ...; L6:                    unreachable code, removed
+//   jne L5; jmp L6; L5:                 becomes je L6
+//   jmp L5 ... L5: jmp L6               jump to a jump, goes to L6
+//   movq $0, %r10                       becomes xorl %r10d, %r10d
+
+#include "data.h"
+#include "arena.h"
+#include "cg.h"
+#include "peep.h"
+
+#define MAXPASSES 10      // Most passes over a function
+#define MAXHOPS 8         // Longest chain of jumps that we follow
+
+// The peephole rules
+enum {
+  P_SELFMOVE, P_STORELOAD, P_LOADSTORE, P_MOVEBACK, P_JUMPNEXT,
+  P_UNREACHABLE, P_JCCJMP, P_JUMPJUMP, P_ZERO, NUMRULES
+};
+
+// What each rule does, for the report
+static char *rulename[] = {
+  "self moves removed",
+  "reloads of a stored value taken from its register",
+  "stores of a value just loaded removed",
+  "moves back removed",
+  "jumps to the next instruction removed",
+  "unreachable instructions removed",
+  "jumps over jumps removed",
+  "jumps to jumps shortened",
+  "zeroing moves made xors"
+};
+
+// Number of times each rule fired in this file
+static int Fired[NUMRULES];
+
+static struct insn **Labels;    // The I_LABEL instruction for each label
+static int Nlabels;             // Size of Labels
+
+// Return true if the operand is the given kind
+static int iskind(struct operand *o, int kind) {
+  if (o == NULL)
+    return 0;
+  return (o->kind == kind);
+}
+
+// Return true if the operand is a full 64-bit register
+static int isreg8(struct operand *o) {
+  if (!iskind(o, OT_REG))
+    return 0;
+  return (o->size == 8);
+}
+
+// Return true if the operand is a frame slot, e.g. -8(%rbp)
+static int isslot(struct operand *o) {
+  if (!iskind(o, OT_MEM))
+    return 0;
+  return (o->reg == R_RBP && o->index == NOREG);
+}
+
+// Return true if the instruction is a 64-bit move between
+// two operands of the kinds given
+static int ismove(struct insn *i, int srckind, int dstkind) {
+  if (i == NULL || i->op != I_MOV || i->size != 8)
+    return 0;
+  return (iskind(i->src, srckind) && iskind(i->dst, dstkind));
+}
+
+// If the instruction loads a register from memory, return
+// the size of the value loaded, otherwise zero
+static int loadsize(struct insn *i) {
+  if (i == NULL || i->size != 8 || !iskind(i->src, OT_MEM) ||
+      !iskind(i->dst, OT_REG))
+    return 0;
+  switch (i->op) {
+    case I_MOV:
+      return 8;
+    case I_MOVSL:
+      return 4;
+    case I_MOVZB:
+      return 1;
+  }
+  return 0;
+}
+
+// Return true if the instruction only works on registers
+// and immediates, and doesn't change register r
+static int regonly(struct insn *i, int r) {
+  if (i == NULL || i->impuse != 0 || i->impdef != 0)
+    return 0;
+  switch (i->op) {
+    case I_MOV:
+    case I_MOVZB:
+    case I_MOVSL:
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_AND:
+    case I_OR:
+    case I_XOR:
+    case I_SHL:
+    case I_SHR:
+    case I_SAR:
+    case I_NEG:
+    case I_NOT:
+    case I_CMP:
+    case I_TEST:
+    case I_SET:
+      break;
+    default:
+      return 0;
+  }
+  if (i->src != NULL && !iskind(i->src, OT_REG) && !iskind(i->src, OT_IMM))
+    return 0;
+  if (!iskind(i->dst, OT_REG))
+    return 0;
+  return (i->dst->reg != r);
+}
+
+// Return true if the instruction loads a frame
+// slot into a register other than r
+static int otherload(struct insn *i, int r) {
+  if (!ismove(i, OT_MEM, OT_REG) || !isslot(i->src))
+    return 0;
+  return (i->dst->reg != r);
+}
+
+// Take an instruction off the list
+static void delinsn(struct insn **head, struct insn *i) {
+  struct insn *prev = i->prev;
+  struct insn *next = i->next;
+
+  if (prev != NULL)
+    prev->next = next;
+  else
+    *head = next;
+  if (next != NULL)
+    next->prev = prev;
+}
+
+// Count a rule firing
+static int fire(int rule) {
+  Fired[rule] = Fired[rule] + 1;
+  return 1;
+}
+
+// Return the label that a direct jump goes to, or -1
+static int jumptarget(struct insn *i) {
+  if (i == NULL || (i->op != I_JMP && i->op != I_JCC))
+    return -1;
+  if (!iskind(i->dst, OT_LABEL))
+    return -1;
+  return i->dst->val;
+}
+
+// Return true if the label is among
+// those directly following instruction i
+static int labelfollows(struct insn *i, int label) {
+  struct insn *j;
+
+  for (j = i->next; j != NULL && j->op == I_LABEL; j = j->next)
+    if (j->dst->val == label)
+      return 1;
+  return 0;
+}
+
+// Return the first real instruction at or after i
+static struct insn *skiplabels(struct insn *i) {
+  while (i != NULL && i->op == I_LABEL)
+    i = i->next;
+  return i;
+}
+
+// Return true if the flags set before instruction i
+// can't be looked at by it or anything after it. We
+// only look along straight-line code.
+static int flagsdead(struct insn *i) {
+  for (; i != NULL; i = i->next) {
+    switch (i->op) {
+      case I_SET:
+      case I_JCC:
+      case I_CMOV:
+      case I_LABEL:
+      case I_TEXT:
+      case I_JMP:
+        return 0;
+      case I_ADD:
+      case I_SUB:
+      case I_IMUL:
+      case I_AND:
+      case I_OR:
+      case I_XOR:
+      case I_NEG:
+      case I_CMP:
+      case I_TEST:
+      case I_IDIV:
+      case I_CALL:
+      case I_TAILCALL:
+        return 1;
+      default:
+        // Shifts by %cl leave the flags alone when %cl is zero
+        if (i->op == I_SHL || i->op == I_SHR || i->op == I_SAR)
+          if (!iskind(i->src, OT_IMM))
+            return 0;
+    }
+  }
+  return 0;
+}
+
+// Build the index from label numbers to their I_LABEL
+static void findlabels(struct insn *head) {
+  struct insn *i;
+  int max = 0;
+
+  for (i = head; i != NULL; i = i->next)
+    if (i->op == I_LABEL && i->dst->val > max)
+      max = i->dst->val;
+
+  Nlabels = max + 1;
+  Labels = (struct insn **) arenaalloc(Funcarena, Nlabels * sizeof(struct insn *));
+  for (i = head; i != NULL; i = i->next)
+    if (i->op == I_LABEL)
+      Labels[i->dst->val] = i;
+}
+
+// Return the instruction which the jump at i ends up
+// at, or NULL if we don't know where it goes
+static struct insn *jumpdest(struct insn *i) {
+  int label = jumptarget(i);
+
+  if (label < 0 || label >= Nlabels || Labels[label] == NULL)
+    return NULL;
+  return skiplabels(Labels[label]);
+}
+
+// Try each rule on the instruction at i. Return true if any
+// change was made, which may include taking i off the list.
+static int peepinsn(struct insn **head, struct insn *i) {
+  struct insn *next = i->next;
+  struct insn *dest;
+  struct operand *o;
+  int hops;
+
+  // movq %r10, %r10
+  if (ismove(i, OT_REG, OT_REG) && i->src->reg == i->dst->reg) {
+    delinsn(head, i);
+    return fire(P_SELFMOVE);
+  }
+
+  // movq %r10, -8(%rbp); movq -8(%rbp), %r11, and the same
+  // for an int or char stored and then loaded with movslq or
+  // movzbq, which can extend the register instead. There can
+  // be a few instructions in between which only use registers,
+  // as long as they leave %r10 alone.
+  if (i->op == I_MOV && iskind(i->src, OT_REG) && isslot(i->dst)) {
+    dest = next;
+    for (hops = 0; hops < MAXHOPS && regonly(dest, i->src->reg); hops++)
+      dest = dest->next;
+    if (i->size == loadsize(dest) && isslot(dest->src) &&
+        dest->src->val == i->dst->val) {
+      if (i->size == 8 && dest->dst->reg == i->src->reg)
+        delinsn(head, dest);
+      else
+        dest->src = i->src;
+      return fire(P_STORELOAD);
+    }
+  }
+
+  // movq -8(%rbp), %r10; movq %r10, -8(%rbp), again with a
+  // few register-only instructions or other loads in between
+  if (ismove(i, OT_MEM, OT_REG) && isslot(i->src)) {
+    dest = next;
+    for (hops = 0; hops < MAXHOPS; hops++) {
+      if (!regonly(dest, i->dst->reg) && !otherload(dest, i->dst->reg))
+        break;
+      dest = dest->next;
+    }
+    if (ismove(dest, OT_REG, OT_MEM) && dest->src->reg == i->dst->reg &&
+        isslot(dest->dst) && dest->dst->val == i->src->val) {
+      delinsn(head, dest);
+      return fire(P_LOADSTORE);
+    }
+  }
+
+  // movq %r10, %r11; movq %r11, %r10
+  if (ismove(i, OT_REG, OT_REG) && ismove(next, OT_REG, OT_REG) &&
+      isreg8(i->src) && isreg8(i->dst) && isreg8(next->src) &&
+      next->src->reg == i->dst->reg && next->dst->reg == i->src->reg) {
+    delinsn(head, next);
+    return fire(P_MOVEBACK);
+  }
+
+  // jmp L5; L5:
+  if (jumptarget(i) >= 0 && labelfollows(i, jumptarget(i))) {
+    delinsn(head, i);
+    return fire(P_JUMPNEXT);
+  }
+
+  // jmp L5; addq %r10, %r11; L6:
+  if ((i->op == I_JMP || i->op == I_TAILCALL) && next != NULL &&
+      next->op != I_LABEL && next->op != I_TEXT) {
+    delinsn(head, next);
+    return fire(P_UNREACHABLE);
+  }
+
+  // jne L5; jmp L6; L5:
+  if (jumptarget(i) >= 0 && i->op == I_JCC && jumptarget(next) >= 0 &&
+      next->op == I_JMP && labelfollows(next, jumptarget(i))) {
+    i->cc = cgccinvert(i->cc);
+    i->dst = next->dst;
+    delinsn(head, next);
+    return fire(P_JCCJMP);
+  }
+
+  // jmp L5 ... L5: jmp L6. We follow a chain of
+  // jumps, but give up on one which goes round in
+  // a loop.
+  o = NULL;
+  dest = jumpdest(i);
+  for (hops = 0; hops < MAXHOPS && dest != NULL && dest->op == I_JMP &&
+                 jumptarget(dest) >= 0; hops++) {
+    o = dest->dst;
+    dest = jumpdest(dest);
+  }
+  if (o != NULL && hops < MAXHOPS && o->val != jumptarget(i)) {
+    i->dst = o;
+    return fire(P_JUMPJUMP);
+  }
+
+  // movq $0, %r10
+  if (i->op == I_MOV && iskind(i->src, OT_IMM) && i->src->val == 0 &&
+      iskind(i->dst, OT_REG) && i->size >= 4 && flagsdead(next)) {
+    // Writing the 32-bit register clears the top half as well
+    i->op = I_XOR;
+    i->size = 4;
+    i->dst = cgoperand(OT_REG, i->dst->reg, 4, 0, NULL);
+    i->src = i->dst;
+    return fire(P_ZERO);
+  }
+
+  return 0;
+}
+
+// Run the peephole rules over a function's instruction
+// list until nothing more changes
+void peephole(struct insn **head) {
+  struct insn *i, *next;
+  int changed = 1, pass;
+
+  findlabels(*head);
+  for (pass = 0; changed && pass < MAXPASSES; pass++) {
+    changed = 0;
+    for (i = *head; i != NULL; i = next) {
+      next = i->next;
+      if (peepinsn(head, i)) {
+        changed = 1;
+        // Look at the changed instruction again
+        if (i->prev != NULL)
+          next = i->prev;
+        else
+          next = *head;
+      }
+    }
+  }
+}
+
+// Print how many times each rule fired in this file
+void peepreport(void) {
+  int n;
+
+  for (n = 0; n < NUMRULES; n++) {
+    printf("  peephole: %d %s\n", Fired[n], rulename[n]);
+    Fired[n] = 0;
+  }
+}
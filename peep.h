@@ -0,0 +1,6 @@
+// Run the peephole rules over a function's
+// instruction list once its registers are allocated
+void peephole(struct insn **head);
+// Print how many times each peephole rule
+// fired in this file, and reset the counts
+void peepreport(void);
@@ -0,0 +1,522 @@
+// Linear-scan register allocator
+//
+// cg.c builds each function as a list of instructions which
+// use as many virtual registers as it likes. Here we give each
+// virtual register a live interval from its first to its last
+// reference, then walk the intervals in order of their start
+// and hand out the physical registers. An interval can't be
+// given a physical register that an instruction inside it uses
+// directly, e.g. %rax and %rdx around an idivq, or any register
+// that a call clobbers. When we run out of registers, the interval
+// with the fewest references for its length, counting those inside
+// loops for more, is spilled to a slot in the stack frame,
+// the instructions which use it are rewritten to go through the
+// slot, and the allocation is done again.
+//
+// A value which lives across calls normally gets a callee-saved
+// register, which the prologue saves once. If there are none left
+// but a caller-saved register is free apart from the calls, the
+// value goes in that register and is saved and restored around
+// just the calls it lives across, rather than being spilled.
+//
+// Each instruction n has two points: 2n where it reads its
+// registers, and 2n+1 where it writes them. The liveness
+// worked out over the function's basic blocks (cfg.c) stretches
+// the intervals of values which are live across a jump.
+
+#include "data.h"
+#include "cfg.h"
+#include "cg.h"
+#include "misc.h"
+#include "ra.h"
+
+// Physical registers that we hand out, in order of preference.
+// The caller-saved ones come first as they cost nothing to use;
+// the callee-saved ones are saved by the function's prologue.
+static int allocorder[] = {
+  R_R10, R_R11, R_R9, R_R8, R_RSI, R_RDI, R_RCX, R_RDX, R_RAX,
+  R_RBX, R_R12, R_R13, R_R14, R_R15
+};
+#define NUMALLOCREGS 14
+
+static struct insn **Code;  // The instructions in list order
+static int Ninsns;          // Number of instructions
+static int Nvregs;          // Number of virtual registers plus FIRSTVREG
+static int Firsttemp;       // First virtual register made by spilling
+static int *Occupied;       // Mask of physical registers busy at each point
+static int *Clobbered;      // Registers busy at each point only as a call
+                            // changes them
+static int *Start, *End;    // Live interval of each virtual register
+static int *Phys;           // Physical register given to each one
+static int *Spilled;        // Set if the virtual register must be spilled
+static int *Callsaved;      // Set if it is saved around calls
+static int *Hint;           // Physical register it is moved to or from
+static int *Refs;           // References to it, weighted by loop depth
+static int *Depth;          // Number of loops around each instruction
+
+// Registers read and written by the instruction
+// last passed to insnregs()
+static int Uses[4], Defs[4];
+static int Nuses, Ndefs;
+
+static void insnregs(struct insn *i) {
+  Nuses = insnuses(i, Uses);
+  Ndefs = insndefs(i, Defs);
+}
+
+// Walk the instructions backwards to find out which
+// physical registers hold a value at each point
+static void findoccupied(void) {
+  struct bblock *b;
+  struct insn *i;
+  int n, k, uses, defs, live = 0;
+
+  for (n = Ninsns - 1; n >= 0; n--) {
+    i = Code[n];
+    insnregs(i);
+    uses = i->impuse;
+    defs = i->impdef;
+    for (k = 0; k < Nuses; k++)
+      if (Uses[k] < FIRSTVREG)
+        uses = uses | (1 << Uses[k]);
+    for (k = 0; k < Ndefs; k++)
+      if (Defs[k] < FIRSTVREG)
+        defs = defs | (1 << Defs[k]);
+
+    // At the end of a block, the registers live
+    // are the ones its successors need
+    b = insnblock(i);
+    if (i == b->last)
+      live = physmask(b->liveout);
+
+    Occupied[2 * n + 1] = live | defs;
+    Clobbered[2 * n + 1] = 0;
+    Clobbered[2 * n] = 0;
+    if (i->op == I_CALL)
+      Clobbered[2 * n + 1] = i->impdef & ~live;
+    live = (live & ~defs) | uses;
+    Occupied[2 * n] = live;
+  }
+}
+
+// Extend the interval of virtual register r to cover the point
+static void touch(int r, int point) {
+  if (r < FIRSTVREG)
+    return;
+  if (Start[r] == -1 || point < Start[r])
+    Start[r] = point;
+  if (point > End[r])
+    End[r] = point;
+}
+
+// Note the physical register that a virtual
+// register is moved to or from, if any
+static void findhint(struct insn *i) {
+  if (i->op != I_MOV || i->src->kind != OT_REG || i->dst->kind != OT_REG)
+    return;
+  if (i->src->reg >= FIRSTVREG && i->dst->reg < FIRSTVREG &&
+      Hint[i->src->reg] == NOREG)
+    Hint[i->src->reg] = i->dst->reg;
+  if (i->dst->reg >= FIRSTVREG && i->src->reg < FIRSTVREG &&
+      Hint[i->dst->reg] == NOREG)
+    Hint[i->dst->reg] = i->src->reg;
+}
+
+// Return how much an instruction inside loops
+// nested depth deep counts for
+static int weight(int depth) {
+  if (depth > 3)
+    depth = 3;
+  return (1 << (3 * depth));
+}
+
+// Count a reference to virtual register r,
+// made inside loops nested depth deep
+static void addref(int r, int depth) {
+  if (r >= FIRSTVREG)
+    Refs[r] = Refs[r] + weight(depth);
+}
+
+// Return an array with the number of loops around each
+// instruction. A jump back to an earlier block makes a
+// loop of all the instructions in between.
+static int *loopdepth(void) {
+  struct bblock *b;
+  int *depth;
+  int n, k, s, top;
+
+  depth = (int *) malloc(Ninsns * sizeof(int));
+  for (n = 0; n < Ninsns; n++)
+    depth[n] = 0;
+  for (n = 0; n < Ninsns; n++) {
+    b = insnblock(Code[n]);
+    if (b->last == Code[n]) {
+      for (s = 0; s < b->nsucc; s++) {
+        if (b->succ[s]->id <= b->id) {
+          // Find the top of the loop
+          top = n;
+          while (top > 0 && Code[top] != b->succ[s]->first)
+            top--;
+          for (k = top; k <= n; k++)
+            depth[k] = depth[k] + 1;
+        }
+      }
+    }
+  }
+  return depth;
+}
+
+static void findintervals(void) {
+  int n, k;
+
+  Depth = loopdepth();
+  for (n = 0; n < Ninsns; n++) {
+    insnregs(Code[n]);
+    for (k = 0; k < Nuses; k++) {
+      touch(Uses[k], 2 * n);
+      addref(Uses[k], Depth[n]);
+    }
+    for (k = 0; k < Ndefs; k++) {
+      touch(Defs[k], 2 * n + 1);
+      addref(Defs[k], Depth[n]);
+    }
+    findhint(Code[n]);
+  }
+}
+
+// Return the cost of saving and restoring virtual
+// register v around the calls inside its interval
+static int callcost(int v) {
+  int n, cost = 0;
+
+  for (n = (Start[v] + 1) / 2; 2 * n + 1 < End[v]; n++)
+    if (Code[n]->op == I_CALL)
+      cost = cost + 2 * weight(Depth[n]);
+  return cost;
+}
+
+// Return true if it costs less to spill virtual register
+// a than b: a has fewer references for the length of its
+// interval
+static int cheaper(int a, int b) {
+  return (Refs[a] * (End[b] - Start[b] + 1) <
+          Refs[b] * (End[a] - Start[a] + 1));
+}
+
+// A value which is live on entry to a block or on exit from
+// it must have its interval cover the block's first or last
+// instruction, e.g. a value used round a loop stays live
+// until the jump back to the top
+static void livethrough(void) {
+  struct bblock *b;
+  int n, v;
+
+  for (n = 0; n < Ninsns; n++) {
+    b = insnblock(Code[n]);
+    for (v = FIRSTVREG; v < Nvregs; v++) {
+      if (b->first == Code[n] && inset(b->livein, v))
+        touch(v, 2 * n);
+      if (b->last == Code[n] && inset(b->liveout, v))
+        touch(v, 2 * n + 1);
+    }
+  }
+}
+
+// Choose a physical register which is not in the busy mask,
+// or return NOREG if there are none
+static int pickreg(int v, int busy) {
+  int n, r;
+
+  r = Hint[v];
+  if (r != NOREG && r != R_RSP && r != R_RBP && (busy & (1 << r)) == 0)
+    return r;
+
+  for (n = 0; n < NUMALLOCREGS; n++) {
+    r = allocorder[n];
+    if ((busy & (1 << r)) == 0)
+      return r;
+  }
+  return NOREG;
+}
+
+// Walk the intervals in order of their start and give each
+// one a physical register. Return the number of virtual
+// registers which have been marked to be spilled.
+static int allocate(void) {
+  int *bucket, *nextinbucket;
+  int active[NUMALLOCREGS];
+  int nactive = 0, nspilled = 0;
+  int p, v, a, k, r, forbid, callfree, busy, best;
+
+  // Make a list of the intervals starting at each point
+  bucket = (int *) malloc(2 * Ninsns * sizeof(int));
+  nextinbucket = (int *) malloc(Nvregs * sizeof(int));
+  for (p = 0; p < 2 * Ninsns; p++)
+    bucket[p] = -1;
+  for (v = Nvregs - 1; v >= FIRSTVREG; v--) {
+    if (Start[v] != -1) {
+      nextinbucket[v] = bucket[Start[v]];
+      bucket[Start[v]] = v;
+    }
+  }
+
+  for (p = 0; p < 2 * Ninsns; p++) {
+    for (v = bucket[p]; v != -1; v = nextinbucket[v]) {
+      // Retire the intervals which have ended
+      k = 0;
+      for (a = 0; a < nactive; a++) {
+        if (End[active[a]] >= Start[v]) {
+          active[k] = active[a];
+          k++;
+        }
+      }
+      nactive = k;
+
+      // Find the physical registers that are used
+      // directly during this interval
+      forbid = callfree = 0;
+      for (k = Start[v]; k <= End[v]; k++) {
+        forbid = forbid | Occupied[k];
+        callfree = callfree | (Occupied[k] & ~Clobbered[k]);
+      }
+
+      busy = forbid;
+      for (a = 0; a < nactive; a++)
+        busy = busy | (1 << Phys[active[a]]);
+
+      r = pickreg(v, busy);
+
+      // Try a register which is only busy because calls
+      // change it, and save it around them if that costs
+      // less than spilling it
+      if (r == NOREG && callcost(v) <= Refs[v]) {
+        busy = callfree;
+        for (a = 0; a < nactive; a++)
+          busy = busy | (1 << Phys[active[a]]);
+        r = pickreg(v, busy);
+        if (r != NOREG)
+          Callsaved[v] = 1;
+      }
+
+      if (r == NOREG) {
+        // Find the active interval which is cheapest to spill
+        // and whose register we could use. Spill temporaries
+        // are never spilled again.
+        best = -1;
+        for (a = 0; a < nactive; a++)
+          if (active[a] < Firsttemp && (forbid & (1 << Phys[active[a]])) == 0)
+            if (best == -1 || cheaper(active[a], active[best]))
+              best = a;
+
+        if (best != -1 && (v >= Firsttemp || cheaper(active[best], v))) {
+          r = Phys[active[best]];
+          Spilled[active[best]] = 1;
+          nactive--;
+          active[best] = active[nactive];
+          nspilled++;
+        } else {
+          if (v >= Firsttemp)
+            fatal("Out of registers for spill temporaries");
+          Spilled[v] = 1;
+          nspilled++;
+        }
+      }
+
+      if (r != NOREG) {
+        Phys[v] = r;
+        active[nactive] = v;
+        nactive++;
+      }
+    }
+  }
+
+  free(bucket);
+  free(nextinbucket);
+  return nspilled;
+}
+
+static void replacereg(struct operand *o, int v, int t) {
+  if (o != NULL && (o->kind == OT_REG || o->kind == OT_MEM) && o->reg == v)
+    o->reg = t;
+  if (o != NULL && o->kind == OT_MEM && o->index == v)
+    o->index = t;
+}
+
+// Put instruction new on the list before instruction i
+static void insbefore(struct insn **head, struct insn *i, struct insn *new) {
+  new->prev = i->prev;
+  new->next = i;
+  if (i->prev != NULL)
+    i->prev->next = new;
+  else
+    *head = new;
+  i->prev = new;
+}
+
+// Put instruction new on the list after instruction i
+static void insafter(struct insn *i, struct insn *new) {
+  new->prev = i;
+  new->next = i->next;
+  if (i->next != NULL)
+    i->next->prev = new;
+  i->next = new;
+}
+
+// Spill virtual register v to a new stack slot. Each instruction
+// that uses it gets a new short-lived virtual register which is
+// loaded from the slot before and stored back after the instruction.
+// Return the number of loads and stores added.
+static int spill(struct insn **head, int v) {
+  struct insn *i, *ld, *st;
+  int slot, t, k, use, def, count = 0;
+
+  slot = cgspillslot();
+  for (i = *head; i != NULL; i = i->next) {
+    insnregs(i);
+    use = def = 0;
+    for (k = 0; k < Nuses; k++)
+      if (Uses[k] == v)
+        use = 1;
+    for (k = 0; k < Ndefs; k++)
+      if (Defs[k] == v)
+        def = 1;
+
+    if (use || def) {
+      t = Nvregs;
+      Nvregs++;
+      replacereg(i->src, v, t);
+      replacereg(i->dst, v, t);
+
+      if (use) {
+        // movq slot(%rbp), t
+        ld = cginsn(I_MOV, 8, cgoperand(OT_MEM, R_RBP, 8, slot, NULL),
+                    cgoperand(OT_REG, t, 8, 0, NULL));
+        insbefore(head, i, ld);
+        count++;
+      }
+
+      if (def) {
+        // movq t, slot(%rbp)
+        st = cginsn(I_MOV, 8, cgoperand(OT_REG, t, 8, 0, NULL),
+                    cgoperand(OT_MEM, R_RBP, 8, slot, NULL));
+        insafter(i, st);
+        i = st;
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+// Save the register of virtual register v to a new stack
+// slot before each call which its interval crosses, and
+// load it back after. Return the number of moves added.
+static int savearound(struct insn **head, int v) {
+  struct insn *i;
+  int n, slot, count = 0;
+
+  slot = cgspillslot();
+  for (n = 0; n < Ninsns; n++) {
+    i = Code[n];
+    if (i->op == I_CALL && Start[v] < 2 * n && End[v] > 2 * n + 1) {
+      // movq v, slot(%rbp); call; movq slot(%rbp), v
+      insbefore(head, i, cginsn(I_MOV, 8, cgoperand(OT_REG, v, 8, 0, NULL),
+                                cgoperand(OT_MEM, R_RBP, 8, slot, NULL)));
+      insafter(i, cginsn(I_MOV, 8, cgoperand(OT_MEM, R_RBP, 8, slot, NULL),
+                         cgoperand(OT_REG, v, 8, 0, NULL)));
+      count = count + 2;
+    }
+  }
+  return count;
+}
+
+static void assignreg(struct operand *o) {
+  if (o != NULL && (o->kind == OT_REG || o->kind == OT_MEM) && o->reg >= FIRSTVREG)
+    o->reg = Phys[o->reg];
+  if (o != NULL && o->kind == OT_MEM && o->index >= FIRSTVREG)
+    o->index = Phys[o->index];
+}
+
+int regalloc(struct insn **head, int nvregs) {
+  struct insn *i;
+  int n, v, nspilled, oldnvregs, count = 0;
+
+  Nvregs = nvregs;
+  Firsttemp = nvregs;
+
+  while (1) {
+    // Put the instructions in an array
+    Ninsns = 0;
+    for (i = *head; i != NULL; i = i->next)
+      Ninsns++;
+    Code = (struct insn **) malloc(Ninsns * sizeof(struct insn *));
+    for (i = *head, n = 0; i != NULL; i = i->next, n++)
+      Code[n] = i;
+
+    Occupied = (int *) malloc(2 * Ninsns * sizeof(int));
+    Clobbered = (int *) malloc(2 * Ninsns * sizeof(int));
+    Start = (int *) malloc(Nvregs * sizeof(int));
+    End = (int *) malloc(Nvregs * sizeof(int));
+    Phys = (int *) malloc(Nvregs * sizeof(int));
+    Spilled = (int *) malloc(Nvregs * sizeof(int));
+    Callsaved = (int *) malloc(Nvregs * sizeof(int));
+    Hint = (int *) malloc(Nvregs * sizeof(int));
+    Refs = (int *) malloc(Nvregs * sizeof(int));
+    for (v = 0; v < Nvregs; v++) {
+      Start[v] = End[v] = -1;
+      Phys[v] = Hint[v] = NOREG;
+      Spilled[v] = Callsaved[v] = Refs[v] = 0;
+    }
+
+    liveness(buildcfg(*head), Nvregs);
+    findoccupied();
+    findintervals();
+    livethrough();
+    nspilled = allocate();
+    if (nspilled == 0)
+      break;
+
+    // Rewrite the spilled registers and try again
+    oldnvregs = Nvregs;
+    for (v = FIRSTVREG; v < oldnvregs; v++)
+      if (Spilled[v])
+        count += spill(head, v);
+
+    free(Code);
+    free(Occupied);
+    free(Clobbered);
+    free(Start);
+    free(End);
+    free(Phys);
+    free(Spilled);
+    free(Callsaved);
+    free(Hint);
+    free(Refs);
+    free(Depth);
+  }
+
+  // Save the values in caller-saved registers across calls
+  for (v = FIRSTVREG; v < Nvregs; v++)
+    if (Callsaved[v])
+      count += savearound(head, v);
+
+  // Replace the virtual registers with physical ones
+  for (i = *head; i != NULL; i = i->next) {
+    assignreg(i->src);
+    assignreg(i->dst);
+  }
+
+  free(Code);
+  free(Occupied);
+  free(Clobbered);
+  free(Start);
+  free(End);
+  free(Phys);
+  free(Spilled);
+  free(Callsaved);
+  free(Hint);
+  free(Refs);
+  free(Depth);
+  return count;
+}
@@ -0,0 +1,4 @@
+// Allocate physical registers for the virtual
+// registers in a function's instruction list.
+// Return the number of spill instructions added.
+int regalloc(struct insn **head, int nvregs);
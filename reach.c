@@ -0,0 +1,179 @@
+// Reachability of statics
+//
+// A static function or global variable can only be used in
+// the file which defines it, so once the whole file is parsed
+// we know whether anything needs it. Functions which aren't
+// static can be called from other files, so they are always
+// written out, along with every static they refer to, every
+// static those refer to, and so on. The rest are left out:
+// e.g. a small static function once all its calls have been
+// inlined, or a helper only called from it.
+//
+// The assembly for a static function is written to a scratch
+// file as it is generated, and copied to the assembly file at
+// the end if the function turns out to be used.
+
+#include "data.h"
+#include "arena.h"
+#include "cg.h"
+#include "misc.h"
+#include "reach.h"
+
+static struct staticsym *Statichead;  // The functions and statics so far
+static struct staticsym *Statictail;
+static FILE *Scratch;                 // Held back assembly
+static FILE *Mainout;                 // The assembly file while holding
+static struct staticsym *Holding;     // Function being held back, or NULL
+static int Nfuncsleft;                // Functions left out in this file
+static int Nvarsleft;                 // and variables
+
+void clearstatics(void) {
+  Statichead = Statictail = NULL;
+  Holding = NULL;
+  Scratch = NULL;
+}
+
+// Add a function or variable to the list
+static struct staticsym *addstatic(struct symtable *sym) {
+  struct staticsym *s;
+
+  s = (struct staticsym *) arenaalloc(Globarena, sizeof(struct staticsym));
+  s->sym = sym;
+  s->used = 0;
+  s->start = s->end = -1;
+  s->refs = NULL;
+  s->nrefs = 0;
+  s->next = NULL;
+  if (Statichead == NULL)
+    Statichead = s;
+  else
+    Statictail->next = s;
+  Statictail = s;
+  return s;
+}
+
+// Return the list entry for the symbol, or NULL
+static struct staticsym *findstatic(struct symtable *sym) {
+  struct staticsym *s;
+
+  for (s = Statichead; s != NULL; s = s->next)
+    if (s->sym == sym)
+      return s;
+  return NULL;
+}
+
+// Walk the tree and put the statics it refers to, other than
+// the function self, in refs from position n. Return the new n.
+// With refs NULL, just count them.
+static int findrefs(struct ASTnode *t, struct symtable *self,
+                    struct symtable **refs, int n) {
+  struct symtable *sym;
+
+  if (t == NULL)
+    return n;
+  sym = t->sym;
+  if (sym != NULL && sym != self && sym->class == C_STATIC) {
+    if (refs != NULL)
+      refs[n] = sym;
+    n++;
+  }
+  n = findrefs(t->left, self, refs, n);
+  n = findrefs(t->mid, self, refs, n);
+  return findrefs(t->right, self, refs, n);
+}
+
+void notefunction(struct ASTnode *n) {
+  struct staticsym *s;
+
+  s = addstatic(n->sym);
+  s->nrefs = findrefs(n->left, n->sym, NULL, 0);
+  s->refs = (struct symtable **) arenaalloc(Globarena,
+                               (s->nrefs + 1) * sizeof(struct symtable *));
+  findrefs(n->left, n->sym, s->refs, 0);
+
+  if (n->sym->class != C_STATIC) {
+    s->used = 1;
+    return;
+  }
+
+  // Send the function's assembly to the scratch file
+  if (Scratch == NULL && (Scratch = tmpfile()) == NULL)
+    fatal("Unable to create a scratch file");
+  Holding = s;
+  Holding->start = ftell(Scratch);
+  Mainout = Outfile;
+  Outfile = Scratch;
+  cgnoseg();
+}
+
+void endfunction(void) {
+  if (Holding == NULL)
+    return;
+  Holding->end = ftell(Scratch);
+  Holding = NULL;
+  Outfile = Mainout;
+  cgnoseg();
+}
+
+void holdglobal(struct symtable *sym) {
+  if (findstatic(sym) == NULL)
+    addstatic(sym);
+}
+
+// Mark the statics that a used function refers to as used
+static void markrefs(struct staticsym *s) {
+  struct staticsym *t;
+  int k;
+
+  for (k = 0; k < s->nrefs; k++) {
+    t = findstatic(s->refs[k]);
+    if (t != NULL && !t->used) {
+      t->used = 1;
+      markrefs(t);
+    }
+  }
+}
+
+// Copy a static function's assembly to the assembly file
+static void copyheld(struct staticsym *s) {
+  long k;
+
+  fseek(Scratch, s->start, SEEK_SET);
+  for (k = s->start; k < s->end; k++)
+    fputc(fgetc(Scratch), Outfile);
+  cgnoseg();
+}
+
+void writestatics(void) {
+  struct staticsym *s;
+  struct symtable *sym;
+
+  for (s = Statichead; s != NULL; s = s->next)
+    if (s->used)
+      markrefs(s);
+
+  for (s = Statichead; s != NULL; s = s->next) {
+    sym = s->sym;
+    if (sym->class == C_STATIC) {
+      if (!s->used) {
+        if (sym->stype == S_FUNCTION)
+          Nfuncsleft++;
+        else
+          Nvarsleft++;
+      } else if (sym->stype == S_FUNCTION)
+        copyheld(s);
+      else
+        cgglobsym(sym);
+    }
+  }
+
+  if (Scratch != NULL)
+    fclose(Scratch);
+  Scratch = NULL;
+}
+
+void staticreport(void) {
+  printf("  unused statics: %d functions and %d variables left out\n",
+         Nfuncsleft, Nvarsleft);
+  Nfuncsleft = Nvarsleft = 0;
+}
@@ -0,0 +1,14 @@
+// Forget the statics of the last input file
+void clearstatics(void);
+// Note the statics which a function's tree refers to. The
+// assembly for a static function is then held back until
+// we know whether it is used.
+void notefunction(struct ASTnode *n);
+// Stop holding back the function's assembly
+void endfunction(void);
+// Hold back a static global variable
+void holdglobal(struct symtable *sym);
+// Write out the statics that are used
+void writestatics(void);
+// Print and reset the count of statics left out
+void staticreport(void);
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "data.h"
+#include "cpp.h"
 #include "misc.h"
 #include "scan.h"
 
@@ -23,12 +24,27 @@ char *Tstring[] = {
   "->", ":"
 };
 
-// Whether or not we are at a start of a line
-int Linestart = 1;
+// The rest of the line we got from the preprocessor
+static char *Inptr;
+
+// Get the next character of preprocessed input,
+// or EOF at the end of input
+static int rawch(void) {
+  int c;
+
+  if (Inptr == NULL || *Inptr == 0) {
+    Inptr = ppline();
+    if (Inptr == NULL)
+      return EOF;
+  }
+  c = *Inptr & 0xff;
+  Inptr++;
+  return c;
+}
 
 // Get the next char from the input file.
 static int next_ch(void) {
-  int c, l;
+  int c;
 
   // If a character was previously asked to be put back,
   // we now return that character and reset the Putback
@@ -40,47 +56,13 @@ static int next_ch(void) {
   }
 
   // If no character was asked to be putback, we get a new
-  // character from the input stream.
-  c = fgetc(Infile);
-
-  while (Linestart && c == '#') { // Hit a preprocessor statement
-    Linestart = 0;    // No longer at start of line
-    scan(&Token);
-
-    // This is the line number of the following line
-    if (Token.token != T_INTLIT)
-      fatals("Expecting pre-processor line number, got", Text);
-    l = Token.intvalue;
-
-    scan(&Token);
-    // The file from which the following line is from
-    if (Token.token != T_STRLIT)
-      fatals("Expecting pre-processor filename, got", Text);
-
-    // Check if this is a real filename
-    if (Text[0] != '<') {
-      // Update the filename if it does not match
-      // the current one we have
-      if (strcmp(Text, Infilename))
-        Infilename = strdup(Text);
-      // Update the line number
-      Line = l;
-    }
-
-    // Skip to EOL
-    while ((c = fgetc(Infile)) != '\n');
-    c = fgetc(Infile);
-    Linestart = 1;    // Back at start of line
-  }
-
-  Linestart = 0;
+  // character from the input buffer.
+  c = rawch();
 
   // Track what line we are on for the purposes
   // of printing debug messages.
-  if ('\n' == c) {
+  if ('\n' == c)
     Line++;
-    Linestart = 1;
-  }
 
   return c;
 }
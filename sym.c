@@ -1,4 +1,5 @@
 #include "data.h"
+#include "arena.h"
 #include "gen.h"
 #include "misc.h"
 #include "sym.h"
@@ -13,6 +14,66 @@ struct symtable *Unionhead, *Uniontail;
 struct symtable *Enumhead, *Enumtail;
 struct symtable *Typehead, *Typetail;
 
+// The global, struct, union, enum and typedef lists also
+// have a hash index on the symbol names. Symbols in the
+// same bucket are chained through hnext in the order that
+// they were added, so a lookup finds the same symbol that
+// a walk down the list would.
+#define NSYMHASH 1024
+static struct symtable **Globhash, **Structhash, **Unionhash;
+static struct symtable **Enumhash, **Typehash;
+
+// Number of symbol lookups and of the symbols
+// compared against while doing them, for -M
+static int Lookups, Probes;
+
+static int namehash(char *s) {
+  int h = 0;
+
+  // Keep the hash small enough that it can't overflow
+  while (*s) {
+    h = ((h << 5) + h + *s) & 0xffffff;
+    s++;
+  }
+  return h;
+}
+
+// Return a hash index with all buckets empty,
+// reusing the old one if there is one
+static struct symtable **clearhash(struct symtable **hash) {
+  int i;
+
+  if (hash == NULL)
+    hash = (struct symtable **) malloc(NSYMHASH * sizeof(struct symtable *));
+  if (hash == NULL)
+    fatal("Unable to malloc a symbol hash index in clearhash");
+
+  for (i = 0; i < NSYMHASH; i++)
+    hash[i] = NULL;
+  return hash;
+}
+
+// Add a symbol to the end of its bucket in a hash index
+static void hashsym(struct symtable **hash, struct symtable *node) {
+  struct symtable *s;
+  int b;
+
+  node->hnext = NULL;
+  if (node->name == NULL)
+    return;
+
+  b = node->hash & (NSYMHASH - 1);
+  if (hash[b] == NULL) {
+    hash[b] = node;
+    return;
+  }
+
+  s = hash[b];
+  while (s->hnext != NULL)
+    s = s->hnext;
+  s->hnext = node;
+}
+
 void appendsym(struct symtable **head, struct symtable **tail, struct symtable *node) {
   if (head == NULL || tail == NULL || node == NULL)
     fatal("Either head, tail or node is NULL in appendsym");
@@ -31,14 +92,21 @@ void appendsym(struct symtable **head, struct symtable **tail, struct symtable *
 
 struct symtable *newsym(char *name, int type, struct symtable *ctype,
     int stype, int class, int nelems, int posn) {
-  struct symtable *node = (struct symtable *) malloc(sizeof(struct symtable));
-  if (node == NULL)
-    fatal("Unable to malloc a symtable node in newsym");
+  struct arena *a;
+  struct symtable *node;
+
+  // Locals die with their function, everything
+  // else lives until the end of the file
+  a = (class == C_LOCAL) ? Funcarena : Globarena;
+  node = (struct symtable *) arenaalloc(a, sizeof(struct symtable));
 
-  if (name == NULL)
+  if (name == NULL) {
     node->name = NULL;
-  else
-    node->name = strdup(name);
+    node->hash = 0;
+  } else {
+    node->name = arenastrdup(a, name);
+    node->hash = namehash(name);
+  }
   node->type = type;
   node->ctype = ctype;
   node->stype = stype;
@@ -51,9 +119,12 @@ struct symtable *newsym(char *name, int type, struct symtable *ctype,
     node->size = nelems * typesize(type, ctype);
 
   node->st_posn = posn;
+  node->st_reg = NOREG;
+  node->st_addrtaken = 0;
   node->next = NULL;
   node->member = NULL;
   node->initlist = NULL;
+  node->hnext = NULL;
 
   return node;
 }
@@ -66,6 +137,7 @@ struct symtable *addglob(char *name, int type, struct symtable *ctype,
     sym->size = ctype->size;
 
   appendsym(&Globhead, &Globtail, sym);
+  hashsym(Globhash, sym);
   return sym;
 }
 
@@ -96,12 +168,14 @@ struct symtable *addmemb(char *name, int type, struct symtable *ctype,
 struct symtable *addunion(char *name) {
   struct symtable *sym = newsym(name, P_UNION, NULL, 0, C_UNION, 0, 0);
   appendsym(&Unionhead, &Uniontail, sym);
+  hashsym(Unionhash, sym);
   return sym;
 }
 
 struct symtable *addstruct(char *name) {
   struct symtable *sym = newsym(name, P_STRUCT, NULL, 0, C_STRUCT, 0, 0);
   appendsym(&Structhead, &Structtail, sym);
+  hashsym(Structhash, sym);
   return sym;
 }
 
@@ -111,6 +185,7 @@ struct symtable *addstruct(char *name) {
 struct symtable *addenum(char *name, int class, int value) {
   struct symtable *sym = newsym(name, P_INT, NULL, 0, class, 0, value);
   appendsym(&Enumhead, &Enumtail, sym);
+  hashsym(Enumhash, sym);
   return sym;
 }
 
@@ -118,13 +193,16 @@ struct symtable *addenum(char *name, int class, int value) {
 struct symtable *addtypedef(char *name, int type, struct symtable *ctype) {
   struct symtable *sym = newsym(name, type, ctype, 0, C_TYPEDEF, 0, 0);
   appendsym(&Typehead, &Typetail, sym);
+  hashsym(Typehash, sym);
   return sym;
 }
 
 // Find a node with a matching name from the list. If the class given is not 0,
 // also match the node's class with the given class.
 static struct symtable *findsyminlist(char *s, struct symtable *list, int class) {
+  Lookups++;
   for (; list != NULL; list = list->next) {
+    Probes++;
     if ((list->name != NULL) && !strcmp(s, list->name))
       if (class == 0 || class == list->class)
         return list;
@@ -133,8 +211,25 @@ static struct symtable *findsyminlist(char *s, struct symtable *list, int class)
   return NULL;
 }
 
+// Find a node with a matching name using a hash index.
+// If the class given is not 0, also match the node's class.
+static struct symtable *findsyminhash(char *s, struct symtable **hash, int class) {
+  struct symtable *node;
+  int h = namehash(s);
+
+  Lookups++;
+  for (node = hash[h & (NSYMHASH - 1)]; node != NULL; node = node->hnext) {
+    Probes++;
+    if (node->hash == h && !strcmp(s, node->name))
+      if (class == 0 || class == node->class)
+        return node;
+  }
+
+  return NULL;
+}
+
 struct symtable *findglob(char *s) {
-  return findsyminlist(s, Globhead, 0);
+  return findsyminhash(s, Globhash, 0);
 }
 
 struct symtable *findlocl(char *s) {
@@ -165,33 +260,33 @@ struct symtable *findsymbol(char *s) {
   if (node) return node;
 
   // And finally the global list
-  return findsyminlist(s, Globhead, 0);
+  return findsyminhash(s, Globhash, 0);
 }
 
 struct symtable *findunion(char *s) {
-  return findsyminlist(s, Unionhead, 0);
+  return findsyminhash(s, Unionhash, 0);
 }
 
 struct symtable *findstruct(char *s) {
-  return findsyminlist(s, Structhead, 0);
+  return findsyminhash(s, Structhash, 0);
 }
 
 // Find an enum type in the enum list
 // Return a pointer to the found node or NULL if not found.
 struct symtable *findenumtype(char *s) {
-  return (findsyminlist(s, Enumhead, C_ENUMTYPE));
+  return (findsyminhash(s, Enumhash, C_ENUMTYPE));
 }
 
 // Find an enum value in the enum list
 // Return a pointer to the found node or NULL if not found.
 struct symtable *findenumval(char *s) {
-  return (findsyminlist(s, Enumhead, C_ENUMVAL));
+  return (findsyminhash(s, Enumhash, C_ENUMVAL));
 }
 
 // Find a type in the tyedef list
 // Return a pointer to the found node or NULL if not found.
 struct symtable *findtypedef(char *s) {
-  return (findsyminlist(s, Typehead, 0));
+  return (findsyminhash(s, Typehash, 0));
 }
 
 // Find a member in the member list
@@ -209,6 +304,12 @@ void clear_symtable(void) {
   Unionhead = Uniontail = NULL;
   Enumhead = Enumtail = NULL;
   Typehead = Typetail = NULL;
+  Globhash = clearhash(Globhash);
+  Structhash = clearhash(Structhash);
+  Unionhash = clearhash(Unionhash);
+  Enumhash = clearhash(Enumhash);
+  Typehash = clearhash(Typehash);
+  Lookups = Probes = 0;
 }
 
 void freeloclsyms(void) {
@@ -233,6 +334,11 @@ void freestaticsyms(void) {
     }
     prev = g;
   }
+
+  // Rebuild the hash index without the statics
+  Globhash = clearhash(Globhash);
+  for (g = Globhead; g != NULL; g = g->next)
+    hashsym(Globhash, g);
 }
 
 void dumptable(struct symtable *head, char *name, int indent);
@@ -369,4 +475,5 @@ void dumpsymtables(void) {
   dumptable(Enumhead, "Enums", 0);
   printf("\n");
   dumptable(Typehead, "Typedefs", 0);
+  printf("\n%d symbol lookups, %d symbols probed\n", Lookups, Probes);
 }
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+// Nested calls as arguments and wide expressions
+// which need more values live than there are registers
+
+int add(int a, int b) { return(a + b); }
+int mul3(int a, int b, int c) { return(a * b * c); }
+
+int eight(int a, int b, int c, int d, int e, int f, int g, int h) {
+  return(a - b + c - d + e - f + g - h);
+}
+
+int main() {
+  int a, b, c, d, e, f, g, h;
+  int x;
+
+  a= 1; b= 2; c= 3; d= 4; e= 5; f= 6; g= 7; h= 8;
+
+  printf("%d\n", add(add(a, b), add(c, d)));
+  printf("%d\n", mul3(add(a, b), mul3(b, c, d), add(mul3(a, a, a), h)));
+  printf("%d\n", eight(a, add(b, c), c, mul3(d, d, d), e, f, add(g, h), h));
+
+  x= ((a+b)*(c+d) + (e+f)*(g+h)) * (a*b+c*d + (e*f+g*h) *
+     (a+(b+(c+(d+(e+(f+(g+(h+a))))))) - h*(g*(f*(e+(d+(c+(b+a))))))));
+  printf("%d\n", x);
+
+  x= a+(b+(c+(d+(e+(f+(g+(h+(a+(b+(c+(d+(e+(f+(g+(h+(a+(b+c)))))))))))))))));
+  printf("%d\n", x);
+  return(0);
+}
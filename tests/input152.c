@@ -0,0 +1,45 @@
+#include <stdio.h>
+
+// Dense switches use a jump table,
+// sparse ones a binary search
+
+int dense(int x) {
+  switch (x) {
+    case 3: return(30);
+    case 4: return(40);
+    case 5: return(50);
+    case 7: return(70);
+    case 9: return(90);
+    case 10: return(100);
+    default: return(-1);
+  }
+  return(0);
+}
+
+int sparse(int x) {
+  int y = 0;
+  switch (x) {
+    case -1000: y = 1; break;
+    case 77: y = 2;
+    case 5000: y = y + 3; break;
+    case 12: y = 4; break;
+    case 100000: y = 5; break;
+    case -3: y = 6; break;
+    case 1: y = 7; break;
+    case 2: y = 8; break;
+    default: y = 99; break;
+  }
+  return(y);
+}
+
+int main() {
+  int i;
+
+  for (i = 0; i < 12; i++)
+    printf("%d ", dense(i));
+  printf("\n");
+
+  printf("%d %d %d %d %d\n", sparse(-1000), sparse(77), sparse(5000), sparse(12), sparse(100000));
+  printf("%d %d %d %d %d\n", sparse(-3), sparse(1), sparse(2), sparse(0), sparse(-4));
+  return(0);
+}
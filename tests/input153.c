@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+// Macros handled by the built-in preprocessor
+
+#define TEN 10
+#define TWICE(x) ((x) + (x))
+#define MAX(a, b) (a > b ? a : b)
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(a, b) a ## b
+#define LOG(fmt, ...) printf(fmt, __VA_ARGS__)
+
+#if TEN * 2 == 20 && defined(TWICE)
+int big = 1;
+#elif TEN > 5
+int big = 2;
+#else
+int big = 3;
+#endif
+
+#ifdef NOTDEFINED
+int missing = 1;
+#else
+int missing = 0;
+#endif
+
+#if !defined TEN || (1 ? 0 : 1)
+int weird = 1;
+#elif 0x10 >> 2 == 4
+int weird = 4;
+#endif
+
+int self = 5;
+#define self (self + 1)
+
+int main() {
+  int CAT(my, var) = TWICE(TEN);
+
+  printf("%d\n", myvar);
+  printf("%d\n", MAX(3, TWICE(2)));
+  printf("%s\n", STR(hello   world));
+  printf("%s\n", STR(say(  'x',  y )));
+  printf("%s\n", XSTR(TEN));
+  LOG("%d %d\n", big, missing);
+  LOG("%d\n",
+      weird);
+  printf("%d\n", self);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+// Short-circuit && and || in conditions,
+// and as values
+
+int calls;
+
+int check(int x) {
+  calls++;
+  return x;
+}
+
+int count(char *p, int max) {
+  int n = 0;
+
+  while (p && *p != ',' && n < max) {
+    n++;
+    p++;
+  }
+  return n;
+}
+
+int main() {
+  int a = 0, b = 3, c;
+  char *s = "abc,def";
+
+  if (check(a) && check(b))
+    printf("wrong\n");
+  printf("%d\n", calls);
+
+  if (check(b) || check(a))
+    printf("b or a\n");
+  printf("%d\n", calls);
+
+  if (!(a || b))
+    printf("wrong\n");
+  else
+    printf("a or b\n");
+
+  if (!a && !(b < 2) && (a == 0 || check(1)))
+    printf("not a and b\n");
+  printf("%d\n", calls);
+
+  c = (a || b) + (a && b) * 10;
+  printf("%d\n", c);
+  c = a ? 5 : 7;
+  printf("%d\n", c);
+  c = (b && !a) ? 8 : 9;
+  printf("%d\n", c);
+
+  printf("%d\n", count(s, 10));
+  printf("%d\n", count(s, 2));
+  printf("%d\n", count(NULL, 2));
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+// Constant folding, algebraic identities
+// and strength reduction
+
+int g = 3 * 4 + 16 - 10 / 3;
+int calls;
+
+int side(int x) {
+  calls++;
+  return x;
+}
+
+int main() {
+  int x, i;
+  int a[4];
+  char c = 100;
+  long l = -1000;
+
+  printf("%d\n", g);
+  printf("%d %d %d\n", 7 % 3, -7 / 2, ~5 & 0xff);
+  printf("%d %d %d %d\n", 3 < 4, 3 == 4, !0, -(2 - 5));
+  x = 1 && 2;
+  i = 0 || 0;
+  printf("%d %d %d\n", x, i, 1 ? 8 : 9);
+
+  x = 13;
+  printf("%d %d %d\n", (x + 1) + 2, (x - 1) + 5, x - 20);
+  printf("%d %d %d %d\n", x * 1, x + 0, x << 0, (x * 2) * 4);
+  printf("%d %d\n", (x & 0xf0) & 0x3c, x * 0);
+  printf("%d %d\n", side(x) * 0, calls);
+  printf("%d %d\n", side(x) && 0, calls);
+  printf("%d %d\n", x && 1, x || 0);
+
+  // Division and modulo by powers of two round towards zero
+  for (i = -9; i < 10; i = i + 3)
+    printf("%d: %d %d %d %d\n", i, i / 4, i % 4, i / 2, i % 2);
+  printf("%d %d\n", c / 8, c % 8);
+  printf("%d %d\n", l / 16, l % 16);
+  printf("%d %d\n", x >> 1, -x >> 1);
+
+  a[3] = 42;
+  printf("%d\n", a[1 + 2]);
+  if (0)
+    printf("wrong\n");
+  if (2 > 1)
+    printf("right\n");
+  while (0)
+    printf("wrong\n");
+  return 0;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+// Values which live across calls: more of them
+// than there are callee-saved registers
+
+int calls;
+
+int f(int x) {
+  calls++;
+  return x;
+}
+
+int sum(int a, int b) {
+  return a + b;
+}
+
+int main() {
+  int i, total;
+
+  printf("%d\n", f(1) + (f(2) + (f(3) + (f(4) + (f(5) +
+                 (f(6) + (f(7) + (f(8) + f(9)))))))));
+
+  total = 0;
+  for (i = 0; i < 10; i++)
+    total = total + i * f(i) + sum(f(i), f(i + 1)) * (f(2) +
+            (f(3) + (f(4) + (f(5) + (f(6) + (f(7) + f(i)))))));
+  printf("%d\n", total);
+  printf("%d\n", calls);
+  return (0);
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+// Leaf functions, which need no frame when
+// their locals fit below the stack pointer
+
+int square(int x) {
+  int y;
+  y = x * x;
+  return y;
+}
+
+int eight(int a, int b, int c, int d, int e, int f, int g, int h) {
+  return a + b + c + d + e + f + g * 10 + h * 100;
+}
+
+long small() {
+  long a[8];
+  int i;
+  long t;
+
+  for (i = 0; i < 8; i++)
+    a[i] = i * 3;
+  t = 0;
+  for (i = 0; i < 8; i++)
+    t = t + a[i];
+  return t;
+}
+
+long big() {
+  long a[40];
+  int i;
+  long t;
+
+  for (i = 0; i < 40; i++)
+    a[i] = i;
+  t = 0;
+  for (i = 0; i < 40; i++)
+    t = t + a[i];
+  return t;
+}
+
+int main() {
+  int i, t;
+
+  t = 0;
+  for (i = 0; i < 5; i++)
+    t = t + square(i) + eight(1, 2, 3, 4, 5, 6, i, square(i));
+  printf("%d\n", t);
+  printf("%ld %ld\n", small(), big());
+  return (0);
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+// Scalar locals and params kept in registers,
+// alongside ones whose address is taken
+
+void setto(int *p, int val) {
+  *p = val;
+}
+
+int sum8(int a, int b, int c, int d, int e, int f, int g, int h) {
+  g++;
+  h = h * 2;
+  return a + b + c + d + e + f + g + h;
+}
+
+int count(char *s) {
+  int n = 0;
+  while (*s++ != 0)
+    n++;
+  return n;
+}
+
+int main() {
+  int i, x, total;
+  char c;
+  int big;
+  long l;
+  char *p;
+
+  total = 0;
+  for (i = 0; i < 100; i++)
+    total = total + i;
+  printf("%d\n", total);
+
+  // x lives in memory as its address is taken
+  setto(&x, 5);
+  x = x + 1;
+  printf("%d\n", x);
+
+  // Narrow variables still wrap around
+  c = 250;
+  c = c + 10;
+  printf("%d\n", c);
+  big = 2147483647;
+  big++;
+  printf("%d\n", big);
+  l = big;
+  l = l - 1;
+  printf("%ld\n", l);
+
+  p = "hello";
+  p++;
+  printf("%s %d %d\n", p, count(p), sum8(1, 2, 3, 4, 5, 6, 7, 8));
+  return (0);
+}
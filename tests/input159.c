@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+// Constants and variables in memory used
+// directly as instruction operands
+
+int g = 10;
+char buf[4];
+
+int bump() {
+  g = g + 5;
+  return 1;
+}
+
+int main() {
+  int x, y, i;
+  int *p;
+  long l;
+
+  x = 7;
+  printf("%d %d %d %d\n", x + 1, x - 3, x * 6, x & 3);
+  printf("%d %d %d\n", x | 8, x ^ 5, x << 4);
+  printf("%d %d\n", -x >> 1, x < 10);
+
+  // g is loaded, then changed by the call
+  // before the value is used
+  y = g;
+  y = y + bump() + g;
+  printf("%d %d\n", y, g);
+
+  // A variable whose address is taken stays in memory
+  p = &i;
+  i = 3;
+  *p = *p + 4;
+  printf("%d %d\n", i, i * i);
+  for (i = 0; i < 20; i = i + 7)
+    printf("%d\n", i);
+
+  buf[0] = 44;
+  buf[1] = 255;
+  printf("%d %d\n", buf[0], buf[1]);
+
+  l = 1;
+  l = (l << 40) + 3;
+  printf("%ld\n", l);
+  return (0);
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+
+// Array elements and struct members reached
+// with a single scaled-index address
+
+struct item {
+  int id;
+  long total;
+  char tag;
+};
+
+int ga[8];
+long gl[4];
+char gc[6];
+struct item first, second;
+char *letters = "wxyz";
+
+int sum(int *a, int n) {
+  int i, s;
+
+  s = 0;
+  for (i = 0; i < n; i++)
+    s = s + a[i];
+  return s;
+}
+
+void fill(struct item *p, int id, char tag) {
+  p->id = id;
+  p->total = id * 1000;
+  p->tag = tag;
+}
+
+int main() {
+  int la[5];
+  long ll[3];
+  char lc[4];
+  struct item *p;
+  int i, j;
+
+  for (i = 0; i < 8; i++)
+    ga[i] = i * i;
+  printf("%d %d\n", sum(ga, 8), ga[7]);
+
+  for (i = 0; i < 5; i++)
+    la[i] = 10 - i;
+  j = 2;
+  la[j + 1] = la[j] + la[j - 1];
+  printf("%d %d %d\n", la[0], la[3], sum(la, 5));
+
+  for (i = 0; i < 4; i++) {
+    gl[i] = i * 70000;
+    gl[i] = gl[i] * 70000;
+  }
+  ll[2] = gl[3] - gl[1];
+  printf("%ld\n", ll[2]);
+
+  for (i = 0; i < 4; i++)
+    lc[i] = letters[i];
+  gc[5] = lc[i - 1];
+  printf("%c%c %c\n", lc[0], lc[3], gc[5]);
+
+  fill(&first, 1, lc[0]);
+  fill(&second, 2, lc[1]);
+  p = &second;
+  printf("%d %ld %c\n", first.id, first.total, first.tag);
+  printf("%d %ld %c\n", p->id, p->total, p->tag);
+  return (0);
+}
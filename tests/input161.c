@@ -0,0 +1,79 @@
+#include <stdio.h>
+
+// Loop counters which are only used to index arrays
+
+int ga[10];
+long gl[10];
+char *word = "induction";
+
+int sum(int *a, int n) {
+  int i, s;
+
+  s = 0;
+  for (i = 0; i < n; i++)
+    s = s + a[i];
+  return s;
+}
+
+// Two arrays, one of them written
+void widen(long *dst, int *src, int n) {
+  int i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = src[i] * 3;
+}
+
+// Characters, with the counter needed after the loop
+int copyword(char *buf) {
+  int i;
+
+  for (i = 0; word[i] != 0; i++)
+    buf[i] = word[i];
+  for (i = 0; i < 9; i++)
+    buf[i] = word[i];
+  buf[i] = 0;
+  return i;
+}
+
+int main() {
+  int la[8];
+  char lc[12];
+  int i, j, n, s;
+
+  for (i = 0; i < 10; i++)
+    ga[i] = i * i;
+  printf("%d\n", sum(ga, 10));
+  widen(gl, ga, 10);
+  printf("%ld %ld\n", gl[3], gl[9]);
+
+  // Stepping by 2, from a variable, to a limit on the left
+  s = 0;
+  n = 9;
+  j = 1;
+  for (i = j; n > i; i = i + 2)
+    s = s + ga[i];
+  printf("%d\n", s);
+
+  // Counting down
+  for (i = 7; i >= 0; i--)
+    la[i] = 100 - i;
+  s = 0;
+  for (i = 0; i <= 7; i += 3)
+    s = s + la[i];
+  printf("%d %d\n", la[0], s);
+
+  n = copyword(lc);
+  printf("%s %d\n", lc, n);
+
+  // A while loop with the same shape, inside another loop
+  for (j = 0; j < 3; j++) {
+    s = 0;
+    i = 0;
+    while (i < 5) {
+      s = s + ga[i] + la[i];
+      i++;
+    }
+    printf("%d %d\n", j, s);
+  }
+  return (0);
+}
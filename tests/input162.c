@@ -0,0 +1,86 @@
+#include <stdio.h>
+
+// Loop-invariant expressions worked out before the loop
+
+struct box {
+  int w;
+  int h;
+};
+
+int scale = 3;
+int total;
+int *gp;
+
+void bump() {
+  scale = scale + 1;
+}
+
+int area(struct box *b, int n) {
+  int i, s;
+
+  s = 0;
+  for (i = 0; i < n; i++)
+    s = s + b->w * b->h + i;
+  return s;
+}
+
+int main() {
+  struct box b;
+  struct box *nobox;
+  int a[6];
+  int i, n, stride, s, zero;
+
+  b.w = 4;
+  b.h = 5;
+  printf("%d\n", area(&b, 3));
+
+  // The loop doesn't run, so the load through
+  // nobox mustn't be done either
+  nobox = NULL;
+  printf("%d\n", area(nobox, 0));
+
+  // Neither must a division by zero
+  zero = 0;
+  s = 0;
+  for (i = 0; i < zero; i++)
+    s = s + 10 / zero;
+  printf("%d\n", s);
+
+  // Only worked out when the left side of && is true
+  s = 0;
+  for (i = 0; i < 3 && nobox != NULL && nobox->w > i; i++)
+    s = s + 1;
+  printf("%d\n", s);
+
+  stride = 2;
+  n = 6;
+  for (i = 0; i < n; i++)
+    a[i] = i * (stride + scale);
+  printf("%d %d\n", a[1], a[5]);
+
+  // A store through a pointer or a call
+  // may change a global
+  gp = &scale;
+  s = 0;
+  for (i = 0; i < 3; i++) {
+    s = s + scale * 10;
+    *gp = *gp + 1;
+  }
+  printf("%d %d\n", s, scale);
+  s = 0;
+  i = 0;
+  while (i < 3) {
+    s = s + scale;
+    bump();
+    i++;
+  }
+  printf("%d %d\n", s, scale);
+
+  // A global read in a loop which stores to a local
+  total = 7;
+  s = 0;
+  for (i = 0; i < 4; i++)
+    s = s + total * stride;
+  printf("%d\n", s);
+  return (0);
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+
+// Repeated work in a block done once, but not
+// across a store or a call which may change memory
+
+struct pt {
+  int x;
+  int y;
+};
+
+int g;
+
+int norm(struct pt *p) {
+  return p->x * p->x + p->y * p->y;
+}
+
+void addv(int *a, int *b, int i) {
+  a[i] = a[i] + b[i];
+}
+
+int stored(int *a, int i) {
+  int first;
+
+  first = a[i] * 2;
+  a[i] = 7;
+  return first + a[i] * 2;
+}
+
+void setg() {
+  g = g + 10;
+}
+
+int called() {
+  int before;
+
+  before = g * g;
+  setg();
+  return before + g * g;
+}
+
+int sums(int x, int y) {
+  int s, t;
+
+  s = x * y + 1;
+  t = y * x + 1;
+  x = x + 1;
+  return s + t + x * y;
+}
+
+int main() {
+  struct pt p;
+  int a[4];
+  int b[4];
+  int i;
+
+  p.x = 3; p.y = 4;
+  printf("%d\n", norm(&p));
+
+  for (i = 0; i < 4; i++) {
+    a[i] = i;
+    b[i] = 10 * i;
+  }
+  addv(a, b, 2);
+  addv(a, b, 2);
+  printf("%d %d\n", a[2], a[3]);
+  printf("%d\n", stored(a, 1));
+
+  g = 2;
+  printf("%d\n", called());
+  printf("%d\n", sums(3, 5));
+  return 0;
+}
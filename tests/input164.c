@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+// Calls to small functions replaced by their bodies
+
+struct box {
+  int w;
+  int h;
+};
+
+int g;
+int calls;
+
+static int sq(int x) {
+  return x * x;
+}
+
+static int area(struct box *b) {
+  return b->w * b->h;
+}
+
+int twice(int x) {
+  return sq(x) + sq(x + 1);
+}
+
+int bump(int k) {
+  calls++;
+  g = g + k;
+  return g;
+}
+
+// Calls another function, so its
+// arguments must not change under it
+int plusbump(int k) {
+  return k + bump(k);
+}
+
+static long widen(long v) {
+  return v + 1;
+}
+
+static int pick(int c, int a, int b) {
+  return c ? a : b;
+}
+
+int main() {
+  struct box r;
+  int i, s, k;
+  char c;
+
+  r.w = 3; r.h = 4;
+  s = 0;
+  for (i = 0; i < 5; i++)
+    s = s + sq(i) + twice(i);
+  printf("%d %d %d\n", area(&r) + 1, s, sq(7));
+
+  // An argument with a side effect is worked out once
+  i = 2;
+  s = sq(i++);
+  printf("%d %d\n", s, i);
+
+  // The argument is a global which the body changes
+  g = 5;
+  s = plusbump(g);
+  printf("%d %d\n", s, g);
+  k = 1;
+  s = plusbump(k);
+  printf("%d %d %d\n", s, g, calls);
+
+  c = 100;
+  printf("%d\n", (int) widen(c));
+  printf("%d %d\n", pick(1, 10, 20), pick(0, 10, 20));
+  sq(3);
+  return 0;
+}
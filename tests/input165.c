@@ -0,0 +1,68 @@
+#include <stdio.h>
+
+int iseven(int n);
+
+// Each of these recurses far deeper than the
+// stack would allow without tail calls
+int isodd(int n) {
+  if (n == 0)
+    return 0;
+  return iseven(n - 1);
+}
+
+int iseven(int n) {
+  if (n == 0)
+    return 1;
+  return isodd(n - 1);
+}
+
+long sumto(long n, long acc) {
+  if (n == 0)
+    return acc;
+  return sumto(n - 1, acc + n);
+}
+
+int gcd(int a, int b) {
+  if (b == 0)
+    return a;
+  return gcd(b, a % b);
+}
+
+// The arguments swap over, so they must all
+// be worked out before any param is set
+int swapcount(int a, int b, int n) {
+  if (n == 0)
+    return a * 10 + b;
+  return swapcount(b, a, n - 1);
+}
+
+// A local array keeps the frame alive for the call
+int witharray(int n) {
+  int a[2];
+  a[0] = n;
+  a[1] = 0;
+  if (n == 0)
+    return a[1];
+  return witharray(a[0] - 1) + 1;
+}
+
+// Too many arguments to pass in registers
+int seven(int a, int b, int c, int d, int e, int f, int g) {
+  return a + b + c + d + e + f + g;
+}
+
+int callseven(int x) {
+  if (x < 0)
+    return 0;
+  return seven(x, x, x, x, x, x, x + 1);
+}
+
+int main() {
+  printf("%d %d\n", iseven(3000000), isodd(3000000));
+  printf("%ld\n", sumto(3000000, 0));
+  printf("%d\n", gcd(1071, 462));
+  printf("%d %d\n", swapcount(1, 2, 5), swapcount(1, 2, 6));
+  printf("%d\n", witharray(10));
+  printf("%d\n", callseven(3));
+  return 0;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+int min(int x, int y) {
+  return x < y ? x : y;
+}
+
+long max(long x, long y) {
+  return x >= y ? x : y;
+}
+
+char *pick(char *a, char *b, int n) {
+  return n == 0 ? a : b;
+}
+
+int g;
+
+// The dereference must only happen when p isn't NULL
+int value(int *p) {
+  return p != NULL ? *p : -1;
+}
+
+int main() {
+  int a[8];
+  int i, lo, hi, x;
+  char c;
+
+  a[0] = 5; a[1] = -2; a[2] = 9; a[3] = 0;
+  a[4] = 7; a[5] = -8; a[6] = 3; a[7] = 1;
+  lo = a[0];
+  hi = a[0];
+  for (i = 1; i < 8; i++) {
+    lo = min(lo, a[i]);
+    hi = a[i] > hi ? a[i] : hi;
+  }
+  printf("%d %d\n", lo, hi);
+
+  printf("%ld %ld\n", max(-3, 4), max(4, -3));
+  printf("%s %s\n", pick("zero", "other", 0), pick("zero", "other", 1));
+
+  x = 42;
+  printf("%d %d\n", value(&x), value(NULL));
+
+  g = 3;
+  printf("%d %d\n", g > 2 ? g * 4 : g - 1, g != 3 ? g + 1 : -g);
+
+  c = 'a';
+  printf("%d\n", c <= 'z' ? c - 32 : c);
+  return 0;
+}
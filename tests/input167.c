@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+int nums[8];
+
+// Print n in decimal, digit by digit
+void printdec(int n) {
+  if (n < 0) {
+    putchar('-');
+    n = -n;
+  }
+  if (n >= 10)
+    printdec(n / 10);
+  putchar('0' + n % 10);
+}
+
+int main() {
+  int i, x, h;
+  long y;
+
+  nums[0] = 0; nums[1] = 9; nums[2] = -9; nums[3] = 1021;
+  nums[4] = -2147483647 - 1; nums[5] = 2147483647;
+  nums[6] = 123456; nums[7] = -98765;
+
+  for (i = 0; i < 8; i++) {
+    x = nums[i];
+    printf("%d %d %d %d %d %d\n", x / 3, x % 3, x / 7, x % 7, x / -10, x % -10);
+    printf("%d %d %d %d\n", x / 1021, x % 1021, x / 16, x % 16);
+    x /= 6;
+    x %= 1000;
+    printf("%d\n", x);
+  }
+
+  // Hash bucket indexing
+  h = 0;
+  for (i = 0; i < 100; i++)
+    h = (h * 31 + i) % 1021;
+  printf("%d\n", h);
+
+  // Powers of two on longs
+  y = -1000001;
+  printf("%ld %ld %ld\n", y / 8, y % 8, y / -4);
+
+  printdec(-40912);
+  putchar('\n');
+  return 0;
+}
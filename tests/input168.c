@@ -0,0 +1,77 @@
+#include <stdio.h>
+
+int calls;
+
+int next(int x) {
+  calls++;
+  return x + 3;
+}
+
+// Return how many of the string's characters are digits
+int digits(char *s) {
+  int n;
+
+  if (s == NULL)
+    return -1;
+  else
+    n = 0;
+  while (*s) {
+    if (*s < '0' || *s > '9') {
+      s++;
+      continue;
+    }
+    n++;
+    s++;
+  }
+  return n;
+}
+
+int sign(int x) {
+  int s;
+
+  if (x < 0)
+    s = -1;
+  else if (x == 0)
+    s = 0;
+  else
+    s = 1;
+  return s;
+}
+
+int main() {
+  int i, j, sum;
+  char *p;
+
+  // Never entered
+  sum = 0;
+  for (i = 10; i < 5; i++)
+    sum = sum + 100;
+  printf("%d\n", sum);
+
+  // Nested loops, with a break
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 10; j++) {
+      if (j > i)
+        break;
+      sum = sum + j;
+    }
+  }
+  printf("%d\n", sum);
+
+  // A test with side effects and a call, too big to copy
+  calls = 0;
+  i = 0;
+  while (next(i) < 20 && (sum = sum + 1) > 0 && calls < 100 && i >= 0)
+    i = next(i);
+  printf("%d %d %d\n", i, sum, calls);
+
+  printf("%d %d %d\n", digits("a1b22c333"), digits(""), digits(NULL));
+  printf("%d %d %d\n", sign(-5), sign(0), sign(7));
+
+  p = NULL;
+  if (!p)
+    printf("no pointer\n");
+  else
+    printf("pointer\n");
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+
+static int counter;
+static int neverused;
+static int table[4];
+
+// Only called from functions which are left out
+static int helper(int x) {
+  table[0] = x;
+  return x + counter;
+}
+
+static int unused(int x) {
+  return helper(x) * 2;
+}
+
+static int square(int x) {
+  return x * x;
+}
+
+static char *name(void) {
+  return "statics";
+}
+
+static int later(int x);
+
+int first(int *a, int n) {
+  int i;
+
+  i = 0;
+  while (i < n) {
+    if (a[i] < 0) {
+      break;
+      printf("after break\n");
+    }
+    i++;
+  }
+  return i;
+  printf("after return\n");
+  return -1;
+}
+
+int count(int n) {
+  int i, odd;
+
+  odd = 0;
+  i = 0;
+  while (i < n) {
+    i++;
+    if ((i & 1) == 0) {
+      continue;
+      odd = odd + 100;
+    }
+    odd++;
+  }
+  if (0)
+    printf("if (0)\n");
+  while (0)
+    printf("while (0)\n");
+  return odd;
+}
+
+int sign(int x) {
+  if (x < 0) {
+    return -1;
+  } else {
+    return 1;
+  }
+  printf("after if\n");
+  return 0;
+}
+
+int main() {
+  int a[5];
+
+  a[0] = 3; a[1] = 1; a[2] = 4; a[3] = -1; a[4] = 5;
+  counter = 2;
+  printf("%d %d\n", first(a, 5), count(9));
+  printf("%d %d\n", sign(-7), sign(7));
+  printf("%d %s %d\n", square(6), name(), later(1));
+  return 0;
+}
+
+static int later(int x) {
+  return x + counter;
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+// Chains of constants on long operands must be worked
+// out with all 64 bits, not folded into an int literal
+int main() {
+  long x, y;
+  char *p;
+  char *q;
+
+  x = 1;
+  y = (x + 2000000000) + 2000000000;
+  printf("%ld\n", y);
+  y = (x * 65536) * 65536;
+  printf("%ld\n", y);
+  y = (x - 2000000000) - 2000000000;
+  printf("%ld\n", y);
+  y = ((x * 1000) * 1000) * 1000000;
+  printf("%ld\n", y);
+  y = (x + 2000000000) + -2000000000;
+  printf("%ld\n", y);
+  y = (x * 3) * 5;
+  printf("%ld\n", y);
+
+  p = "abcdef";
+  q = (p + 1) + 2;
+  printf("%s\n", q);
+  return 0;
+}
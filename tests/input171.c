@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+#define HERE __LINE__
+#define SHOW(x) printf("%s %d\n", x, __LINE__)
+
+// __LINE__ and __FILE__ are built into the preprocessor
+int main() {
+  printf("%d\n", __LINE__);
+  printf("%s\n", __FILE__);
+  printf("%d\n", HERE);
+  SHOW("from a macro");
+  SHOW(
+    "over two lines");
+#if __LINE__ > 10
+  printf("__LINE__ works in #if\n");
+#endif
+#ifdef __FILE__
+  printf("__FILE__ is defined\n");
+#endif
+#if defined(__LINE__)
+  printf("__LINE__ is defined\n");
+#endif
+  printf("%d\n", __LINE__);
+  return (0);
+}
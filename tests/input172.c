@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+// Both of these would trap if folded by the compiler.
+// They are compiled but never called
+int divmin(void) {
+  return ((-2147483647 - 1) / -1);
+}
+
+int modmin(void) {
+  return ((-2147483647 - 1) % -1);
+}
+
+int main() {
+  printf("%d\n", (-2147483647 - 1) / 1);
+  printf("%d\n", (-2147483647 - 1) % 7);
+  printf("%d\n", (-2147483647) / -1);
+  printf("%d\n", (-2147483647) % -1);
+  return (0);
+}
@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+#define SQ(x) ((x) * (x))
+#define ADD(x, y) ((x) + (y))
+
+// Macro calls which are spread over several lines
+int main() {
+  int a = 3;
+  int b = 4;
+
+  printf("%d\n", SQ(a
+  ));
+  printf("%d %d\n", ADD(a,
+                        b), SQ(b));
+  printf("%d\n", ADD(SQ(a),
+                     SQ(
+                       b)));
+  printf("%d\n", SQ
+         (a));
+  printf("%d\n", ADD
+
+                 (a, b));
+  printf("%d\n", SQ(a)
+    + 1);
+  return (0);
+}
@@ -0,0 +1,5 @@
+10
+648
+-59
+-80025384
+78
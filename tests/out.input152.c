@@ -0,0 +1,3 @@
+-1 -1 -1 30 40 50 -1 70 -1 90 100 -1 
+1 5 3 4 5
+6 7 8 99 99
@@ -0,0 +1,8 @@
+20
+4
+hello world
+say( 'x', y )
+10
+1 0
+4
+6
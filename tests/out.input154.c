@@ -0,0 +1,12 @@
+1
+b or a
+2
+a or b
+not a and b
+2
+1
+7
+8
+3
+2
+0
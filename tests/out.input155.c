@@ -0,0 +1,22 @@
+25
+1 -3 250
+1 0 1 3
+1 0 8
+16 17 -7
+13 13 13 104
+0 0
+0 0
+0 1
+1 1
+-9: -2 -1 -4 -1
+-6: -1 -2 -3 0
+-3: 0 -3 -1 -1
+0: 0 0 0 0
+3: 0 3 1 1
+6: 1 2 3 0
+9: 2 1 4 1
+12 4
+-62 -8
+6 -7
+42
+right
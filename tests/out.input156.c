@@ -0,0 +1,3 @@
+45
+3600
+109
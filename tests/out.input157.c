@@ -0,0 +1,2 @@
+3235
+84 780
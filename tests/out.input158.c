@@ -0,0 +1,6 @@
+4950
+6
+4
+-2147483648
+-2147483649
+ello 4 45
@@ -0,0 +1,10 @@
+8 4 42 3
+15 2 112
+-4 1
+26 15
+7 49
+0
+7
+14
+44 255
+1099511627779
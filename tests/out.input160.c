@@ -0,0 +1,6 @@
+140 49
+10 17 50
+9800000000
+wz z
+1 1000 w
+2 2000 x
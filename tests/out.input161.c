@@ -0,0 +1,8 @@
+285
+27 243
+84
+100 291
+induction 9
+0 520
+1 520
+2 520
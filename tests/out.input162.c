@@ -0,0 +1,8 @@
+63
+0
+0
+0
+5 25
+120 6
+21 9
+56
@@ -0,0 +1,5 @@
+25
+42 3
+16
+148
+52
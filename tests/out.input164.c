@@ -0,0 +1,6 @@
+13 115 49
+4 3
+15 10
+12 11 2
+101
+10 20
@@ -0,0 +1,6 @@
+1 0
+4500001500000
+21
+21 12
+10
+22
@@ -0,0 +1,6 @@
+-8 9
+4 4
+zero other
+42 -1
+12 -3
+65
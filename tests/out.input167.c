@@ -0,0 +1,27 @@
+0 0 0 0 0 0
+0 0 0 0
+0
+3 0 1 2 0 9
+0 9 0 9
+1
+-3 0 -1 -2 0 -9
+0 -9 0 -9
+-1
+340 1 145 6 -102 1
+1 0 63 13
+170
+-715827882 -2 -306783378 -2 214748364 -8
+-2103314 -54 -134217728 0
+-941
+715827882 1 306783378 1 -214748364 7
+2103314 53 134217727 15
+941
+41152 0 17636 4 -12345 6
+120 936 7716 0
+576
+-32921 -2 -14109 -2 9876 -5
+-96 -749 -6172 -13
+-460
+475
+-125000 -1 250000
+-40912
@@ -0,0 +1,6 @@
+0
+10
+18 16 13
+6 0 -1
+-1 0 1
+no pointer
@@ -0,0 +1,3 @@
+3 5
+-1 1
+36 statics 3
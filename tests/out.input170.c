@@ -0,0 +1,7 @@
+4000000001
+4294967296
+-3999999999
+1000000000000
+1
+15
+def
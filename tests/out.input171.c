@@ -0,0 +1,9 @@
+8
+input171.c
+10
+from a macro 11
+over two lines 12
+__LINE__ works in #if
+__FILE__ is defined
+__LINE__ is defined
+23
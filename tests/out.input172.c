@@ -0,0 +1,4 @@
+-2147483648
+-2
+2147483647
+0
@@ -0,0 +1,6 @@
+9
+7 16
+25
+9
+7
+10
@@ -1,4 +1,5 @@
 #include "data.h"
+#include "arena.h"
 #include "misc.h"
 #include "tree.h"
 
@@ -13,12 +14,8 @@ struct ASTnode *mkastnode(int op,
                           int intvalue) {
   struct ASTnode *n;
 
-  n = (struct ASTnode *) malloc(sizeof(struct ASTnode));
-
-  if (n == NULL) {
-    fprintf(stderr, "Out of memory to allocate AST node\n");
-    exit(1);
-  }
+  // AST nodes only live until their function has been generated
+  n = (struct ASTnode *) arenaalloc(Funcarena, sizeof(struct ASTnode));
 
   n->op = op;
   n->type = type;